@@ -1,11 +1,22 @@
 /**********************************************************************
 Program cs2123p3.c by Timothy Hennessy
 Purpose:	
-    Program parses a file and uses a linked list to process
-    the data as time series events.
+    Program parses a file and uses the simulation library
+    (cs2123p3sim.c) to process the data as time series events.
 Command Parameters:
-    No Command Paramters are used in the execution of this 
-    program. 
+    p3 [-t numThreads] [-m budgetKB] [-w tracePrefix] < inputFile
+    p3 -r tracePrefix -q time
+        -t numThreads   run the handlers of events sharing a time
+                        on a pool of numThreads workers (default 1,
+                        which runs the events one at a time)
+        -m budgetKB     hold pending events in an external-memory queue
+                        that keeps at most budgetKB in memory and spills
+                        sorted runs to temporary files (default is the
+                        in-memory linked list)
+        -w tracePrefix  also write the run to tracePrefix.trc (event log)
+                        and tracePrefix.idx (snapshot index)
+        -r tracePrefix  read a trace written by -w instead of running
+        -q time         with -r, list who was present at that time
 Input:
     This program uses the standard input stream for its
     input (i.e., a file is redirected at the command line).  
@@ -32,7 +43,17 @@ Returns:
 Notes:
     1.  User must redirect a properly formatted input file
         from command line for successful execution
-    2.  The program implements a singly linked list
+    2.  The library implements a singly linked list
+    3.  A hash index from person name to pending events is kept
+        alongside the event queue for occupancy queries (with -m only
+        when -w needs it, since it is not bounded by the budget)
+    4.  With -t, events sharing a time are removed together and their
+        handlers run on a pthread pool
+    5.  Build with both sources, e.g.
+        gcc -pthread -o p3 cs2123p3.c cs2123p3sim.c
+    6.  With -w, a snapshot of the people present is indexed about every
+        TRACE_SNAPSHOT_EVENTS events, so -q seeks to the nearest one and
+        replays only the events after it
 **********************************************************************/
 
 /* include files */
@@ -40,191 +61,16 @@ Notes:
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <pthread.h>
 #include "cs2123p3.h"
 
-// linked list functions - you must provide the code for these (see course notes)
-/******************** removeLL *************************************
-int removeLL(LinkedList list, Event  *pValue)
-Purpose:
-    Removes a node from the front of a LinkedList and returns the
-    Event structure (via the parameter list).
-Parameters:
-    I   LinkedList list       pointer to the LinkedList
-    I   Event *pValue         value structure of node being removed
-
-Returns:
-  Functionally
-      TRUE  - LinkedList was not empty
-      FALSE - LinkedList was passed in empty
-  Parameter
-      Event structure containing value of node which was removed
-
-Notes:
-  Removes the first node from the linked list.  Returns the nodes event
-  value via the parameter list.  Sets list->pHead to list->pHead->pNext.
-**************************************************************************/
-int removeLL(LinkedList list, Event *pValue)
-{
-	NodeLL *pRemove;
-	if (list->pHead == NULL)
-		return FALSE;                   // list was passed in empty
-	*pValue = list->pHead->event;       // store Event structure into pValue
-	                                    // so it can be returned via param
-	pRemove = list->pHead;              // set the address of p to first 
-	                                    // node in LinkedList
-	list->pHead = list->pHead->pNext;   // new first node in LinkedList
-	free(pRemove);
-	return TRUE;                        // successfully removed a node
-}
-/******************** allocateNodeLL *************************************
-NodeLL *allocateNodeLL(LinkedList list, Event value)
-Purpose:
-    Allocates new node for LinkedList.
-Parameters:
-    I   LinkedList list       pointer to the LinkedList
-    I   Event value           values to be given to new node
-
-Returns:
-  A pointer to the new dynamically allocated node.
-
-Notes:
-  If dynamic allocation returns NULL pointer the program aborts.    
-**************************************************************************/
-NodeLL *allocateNodeLL(LinkedList list, Event value)
-{
-	NodeLL *pNew;
-	pNew = (NodeLL *) malloc(sizeof(NodeLL));
-	if (pNew == NULL)
-		ErrExit(ERR_ALGORITHM, "No available memory for linked list");
-	pNew->event = value;
-	pNew->pNext = NULL;
-	return pNew;
-}
-/******************** searchLL *******************************************
-NodeLL *searchLL(LinkedList list, int match, NodeLL **ppPrecedes)
-Purpose:
-    Uses match (from argument passed in to function via parameter)
-    to iterate over linked list and find if a NodeLL contains a matching
-    value.
-Parameters:
-    I   LinkedList list       pointer to the LinkedList
-    I   int   match           stores value to be found in LinkedList
-    O   NodeLL ppPrecedes     pointer to a pointer to a NodeLL; used 
-                              to return the address of the NodeLL found
-                              right before the matching NodeLL
-
-Returns:
-  Functionally
-    NULL    - If a match is not found in LinkedList
-    Address - The address of the match in LinkedList
-  Parameter
-    ppPrecedes - returns address of previous NodeLL
-Notes:
-                               Values Returned
-  Condition                    Functionally         Via Param
-  Match at beginning           ppPrecedes = NULL    p = pHead
-  Match Less than first Node   ppPrecedes = NULL    p = NULL
-  Match between Nodes          ppPrecedes = p       p = p->pNext
-  List is empty                ppPrecedes = NULL    p = NULL
-  Match is less than           ppPrecedes = p       p = p->pNext
-  (between nodes)
-**************************************************************************/
-NodeLL *searchLL(LinkedList list, int match, NodeLL **ppPrecedes)
-{
-	NodeLL *pCurrent;
-	// used when the list is empty or we need to insert at the beginning
-	*ppPrecedes = NULL;
-	
-	// Traverse through the list loooking for where the key belongs or
-	// the end of the list.
-	for (pCurrent = list->pHead; pCurrent != NULL; pCurrent = pCurrent->pNext)
-	{
-		if (match == pCurrent->event.iTime)     // assume match is an integer
-			return pCurrent;
-		if (match < pCurrent->event.iTime)      // assume the LL is ordered
-			return NULL;
-		*ppPrecedes = pCurrent;                 // pointer to a NodeLL
-	}
-	// Not found return NULL
-	return NULL;
-}
-/******************** insertOrderedLL *************************************
-NodeLL *insertOrderedLL(LinkedList list, Event value)
-Purpose:
-    Inserts a NodeLL into its respective place in the ordered
-    LinkedList.
-Parameters:
-    I   LinkedList list       pointer to the LinkedList
-    I   Event value           ??
-
-Returns:
-  ?
-
-Notes:
-  ?
-Update so it can add events with the same time value
-**************************************************************************/
-NodeLL *insertOrderedLL(LinkedList list, Event value)
-{
-	NodeLL *pNew;
-	NodeLL *pFind;
-	NodeLL *pPrecedes;
-	// see if it already exists
-	// pFind is not necessary unless we are concerned
-    // about duplicates
-	pFind = searchLL(list, value.iTime, &pPrecedes);
-	// commented out code to allow for duplicates
-	//if (pFind != NULL)
-	//	return pFind;
-	
-	// Allocate a node and insert.
-	pNew = allocateNodeLL(list, value);
-	
-	// Check for inserting at the beginning of the list
-	// this will also handle when the list is empty
-	if (pPrecedes == NULL)
-	{
-		pNew->pNext = list->pHead;
-		list->pHead = pNew;
-	}
-	else
-	{
-		pNew->pNext = pPrecedes->pNext;
-		pPrecedes->pNext = pNew;
-	}
-	return pNew;
-}
-/******************** newLinkedList **************************************
-LinkedList newLinkedList(void)
-Purpose:
-    Dynamically allocates memory for a new linked list.
-Parameters:
-    O   LinkedList list       pointer to a LinkedListImp
-
-Returns:
-    A pointer to a LinkedListImp structure (the pointer is called 
-    list) that has a pointer (called pHead) to a NodeLL initialized to NULL.
-Notes:
-    ?
-**************************************************************************/
-LinkedList newLinkedList()
-{
-	LinkedList list = (LinkedList) malloc(sizeof(LinkedListImp));
-	
-	if (list == NULL)
-		ErrExit(ERR_ALGORITHM, "No available memory for linked list");
-	// Mark the list as empty
-	list->pHead = NULL;      // empty list
-	return list;
-}
-// end of functions from notes
 // begin program 3 functions
 /******************** addEventNodes *******************************************************
-void addEventNodes(LinkedList list, char szPersonName[], int iDepUnits, int iArriveTime)
+void addEventNodes(Simulation sim, char szPersonName[], int iDepUnits, int iArriveTime)
 Purpose:
-    Takes input from stdin and adds it to list.
+    Takes input from stdin and adds it to the simulation.
 Parameters:
-    I  LinkedList list       pointer to a LinkedListImp
+    I  Simulation sim        simulation handle
     I  char szName[]         contains name of person
     I  int iDepUnits         number of clock units until person departs
     I  int iArriveTime       time person arrives
@@ -232,43 +78,31 @@ Parameters:
 Returns:
     N/A
 Notes:
-    Assigns event structure with initial arrival data and adds it to linked list.
-    Next, the event structure is updated with departure data and added to
-    the linked list.
+    simScheduleVisit adds the arrival event and then the departure event.
+    If either cannot be scheduled the program aborts.
 *******************************************************************************************/
-void addEventNodes(LinkedList list, char szPersonName[], int iDepUnits, int iArriveTime)
+void addEventNodes(Simulation sim, char szPersonName[], int iDepUnits, int iArriveTime)
 {
-	Event addEvent;
-	
-    // add data to addEvent structure before inserting into Linked List
-	addEvent.iTime = iArriveTime;            
-	addEvent.iEventType = EVT_ARRIVE;             // set event type to Arrive
-	strcpy(addEvent.person.szName, szPersonName); // store name of person
-	addEvent.person.iDepartUnits = iDepUnits;
-
-	// insert Arrive Event into Linked List
-	insertOrderedLL(list, addEvent);
-	
-	// update addEvent structure before inserting into Linked List
-	addEvent.iEventType = EVT_DEPART;
-	addEvent.iTime = iArriveTime + iDepUnits; 
+	int iStatus;
 	
-	// insert Depart Event into Linked List
-	insertOrderedLL(list, addEvent);
+	iStatus = simScheduleVisit(sim, szPersonName, iArriveTime, iDepUnits);
+	if (iStatus != SIM_OK)
+		ErrExit(ERR_BAD_INPUT, "Unable to schedule %s (status %d)"
+			, szPersonName, iStatus);
 }
 /******************** readEventData **************************************
-int readEventData(LinkedList list)
+int readEventData(Simulation sim)
 Purpose:
-    Takes input from stdin and adds it to list.
+    Takes input from stdin and adds it to the simulation.
 Parameters:
-    I  LinkedList list       pointer to a LinkedListImp
+    I  Simulation sim        simulation handle
 
 Returns:
     Returns a time corresponding to the end of events
 Notes:
     N/A
 **************************************************************************/
-int readEventData(LinkedList list)
+int readEventData(Simulation sim)
 {
 	char szInputBuffer[MAX_LINE_SIZE];    // entire input line
 	int iCurrentArriveTime = 0;           // used to store current
@@ -297,7 +131,7 @@ int readEventData(LinkedList list)
         if (iScanfCnt < 2)
            ErrExit(ERR_ALGORITHM, "Input conversion failed");
 		
-		addEventNodes(list, szToken, iDepartureUnits, iCurrentArriveTime);
+		addEventNodes(sim, szToken, iDepartureUnits, iCurrentArriveTime);
 		// update iArriveTime to reflect when next person will arrive
 		iCurrentArriveTime += iNextArrivalTime;
 	} // end while
@@ -332,11 +166,11 @@ void printLL(LinkedList list)
 	}
 }
 /******************** printEventNode **************************************
-void printEventNode(LinkedList list)
+void printEventNode(Event printEvent)
 Purpose:
     Takes an event structure and prints it out
 Parameters:
-    I  LinkedList list       pointer to a LinkedListImp
+    I  Event printEvent      event to be printed
 
 Returns:
     N/A
@@ -345,142 +179,287 @@ Notes:
 **************************************************************************/
 void printEventNode(Event printEvent)
 {
-	static int i = 0;
-	
-	if (printEvent.iTime == 0 && i == 0)
-	{
-		printf("%-5s %-20s %-15s\n", "Time", "Person", "Event");
-		printf("%-45s\n", "-----------------------------------");
-	}
+	char szLineM[1][MAX_LINE_SIZE];
 	
-	printf("%-5d %-20s %-15s\n"
-			, printEvent.iTime
-			, printEvent.person.szName
-			, (printEvent.iEventType == EVT_ARRIVE) ? ("Arrive") : ("Depart"));
-	
-	i++;
+	formatEventNode(printEvent, 0, szLineM);
+	printEventLine(printEvent, 0, szLineM);
 }
-/************************** freeLL **************************************
-void freeLL(LinkedList list)
+/******************** formatEventNode *************************************
+void formatEventNode(Event event, int iSlot, void *pContext)
 Purpose:
-    Correctly frees an entire linked list ensuring no memory leaks.
+    EventHandler that formats an event's output line.
 Parameters:
-    I  LinkedList list       pointer to a LinkedListImp
+    I  Event event           event to be handled
+    I  int iSlot             event's position in its batch
+    O  void *pContext        BatchLines; line iSlot receives the output
 
 Returns:
     N/A
 Notes:
-    First, this function frees the NodeLL's which have been allocated 
-    memory.  Next, the actual memory allocated for the LinkedListImp
-    structure is freed.  Finally, the pointer pointing to the
-    LinkedListImp is set to NULL.
+    Touches nothing but its own line, so the thread pool may call it for
+    several events at once.
 **************************************************************************/
-void freeLL(LinkedList list)
+void formatEventNode(Event event, int iSlot, void *pContext)
 {
-	NodeLL *pRemove;           // used to iterate through
-	                           // LL 
-	Event removeEvent;   // used to store returned 
-	                     // event from removeLL
-	// list is either free or dangling
-	// not much we can do
-	if (list->pHead == NULL)
-	{
-		free(list);
-		return;
-	}
-	// iterate node-by-node freeing each node
-	for (pRemove = list->pHead; pRemove != NULL; pRemove = pRemove->pNext)
-	{
-		removeLL(list, &removeEvent);     // function frees node at i
-	}
-	// finally free the memory allocated for LinkedListImp structure
-	free(list);
-	// just to make sure the pointer is not used improperly in the future
-	list->pHead = NULL;
+	char (*szLineM)[MAX_LINE_SIZE] = (char (*)[MAX_LINE_SIZE]) pContext;
+	
+	snprintf(szLineM[iSlot], MAX_LINE_SIZE, "%-5d %-20s %-15s\n"
+		, event.iTime
+		, event.person.szName
+		, (event.iEventType == EVT_ARRIVE) ? ("Arrive") : ("Depart"));
 }
-/************************** newSim *******************************************************
-Simulation newSim(LinkedList list)
+/******************** printEventLine **************************************
+void printEventLine(Event event, int iSlot, void *pContext)
 Purpose:
-    Conducts a simulation using the linked list with event nodes.
+    EventCallback that prints the line formatEventNode produced,
+    preceded by the column headings when it is the first event at time 0.
 Parameters:
-    I  Simulation simulation     pointer to a SimulationImp structure
-    I  int iTimeLimit            maximum time allowed before function return
+    I  Event event           event the line was formatted from
+    I  int iSlot             event's position in its batch
+    I  void *pContext        BatchLines holding the line
+
 Returns:
-    A pointer to a SimulationImp structure
+    N/A
 Notes:
-    If memory is unable to be allocated the program aborts.
-*******************************************************************************************/
-Simulation newSim(LinkedList list)
+    The simulation calls it in event order on a single thread.
+**************************************************************************/
+void printEventLine(Event event, int iSlot, void *pContext)
 {
-	Simulation simulation = (Simulation) malloc(sizeof(SimulationImp));
-	
-	if (simulation == NULL)
-	    ErrExit(ERR_ALGORITHM, "No memory available for simulation");
-	// set simulation to point to first node in list
-	simulation->eventList = list;
+	char (*szLineM)[MAX_LINE_SIZE] = (char (*)[MAX_LINE_SIZE]) pContext;
+	static int i = 0;
 	
-	return simulation;
+	if (event.iTime == 0 && i == 0)
+	{
+		printf("%-5s %-20s %-15s\n", "Time", "Person", "Event");
+		printf("%-45s\n", "-----------------------------------");
+	}
+	fputs(szLineM[iSlot], stdout);
+	i++;
 }
 /******************** runSimulation *******************************************************
 void runSimulation(Simulation simulation, int iTimeLimit)
 Purpose:
-    Conducts a simulation using the linked list with event nodes.
+    Conducts a simulation using the events scheduled by readEventData.
 Parameters:
-    I  Simulation simulation     pointer to a SimulationImp structure
+    I  Simulation simulation     simulation handle
     I  int iTimeLimit            maximum time allowed before function return
 Returns:
     N/A
 Notes:
-    The simulation works by iteratively removing the first node in the linked list.
-    The event returned from removeLL (via param) is used for the switch to determine
-    which action to take.  If returned event value from removeLL is not recognized,
-    the program is aborted.  
+    The library runs every event up to iTimeLimit through the registered
+    handler and callback.  As the original loop did, one more event past
+    the limit is run before the simulation terminates.  If the event queue
+    fails the program is aborted.
 *******************************************************************************************/
 void runSimulation(Simulation simulation, int iTimeLimit)
 {
-	Event removedEvent;           // stores NodeLL returned from removeLL	
-	
-	while(removeLL(simulation->eventList, &removedEvent))
-	{
-		// prevent infinite loop
-		if (simulation->iClock > iTimeLimit)
-			break;
-		
-		simulation->iClock = removedEvent.iTime;
-		switch(removedEvent.iEventType)
-		{
-			case EVT_ARRIVE:
-			    printEventNode(removedEvent);
-			    break;
-			case EVT_DEPART:
-			    printEventNode(removedEvent);
-			    break;
-			default:
-			    ErrExit(ERR_ALGORITHM, "Attempt to run simulation with unknown event");
-		} // end switch
-	} // end while
+	if (simRunUntil(simulation, iTimeLimit) < 0 || simStep(simulation, 1) < 0)
+	    ErrExit(ERR_ALGORITHM, "Unable to read the event queue");
 	printf("%-5d %-20s %-15s\n"
-		, simulation->iClock
+		, simGetClock(simulation)
 		, "SIMULATION"
 		, "TERMINATES");
 }
 
-int main(void)
+/******************** openTraceFile **************************************
+FILE *openTraceFile(char *pszPrefix, char *pszSuffix, char *pszMode)
+Purpose:
+    Opens one of the files of a trace.
+Parameters:
+    I  char *pszPrefix       trace prefix from -w or -r
+    I  char *pszSuffix       ".trc" (event log) or ".idx" (index)
+    I  char *pszMode         fopen mode
+
+Returns:
+    The open file.
+Notes:
+    Exits with ERR_COMMAND_LINE if the file cannot be opened.
+**************************************************************************/
+FILE *openTraceFile(char *pszPrefix, char *pszSuffix, char *pszMode)
+{
+	char szFileName[MAX_LINE_SIZE];
+	FILE *pFile;
+	
+	snprintf(szFileName, sizeof(szFileName), "%s%s", pszPrefix, pszSuffix);
+	pFile = fopen(szFileName, pszMode);
+	if (pFile == NULL)
+		exitUsage(USAGE_ERR, ERR_TRACE_FILE, szFileName);
+	return pFile;
+}
+/******************** queryTrace *****************************************
+void queryTrace(char *pszTracePrefix, int iQueryTime)
+Purpose:
+    Prints the people present at iQueryTime in a trace written by -w.
+Parameters:
+    I  char *pszTracePrefix  trace prefix from -r
+    I  int iQueryTime        time from -q
+
+Returns:
+    N/A
+Notes:
+    The name array starts small and is doubled until the query fits.
+**************************************************************************/
+void queryTrace(char *pszTracePrefix, int iQueryTime)
+{
+	FILE *pLogFile = openTraceFile(pszTracePrefix, ".trc", "rb");
+	FILE *pIndexFile = openTraceFile(pszTracePrefix, ".idx", "rb");
+	char (*szNameM)[MAX_NAME_SIZE + 1] = NULL;
+	int iMaxNames = 32;
+	int iPresentCnt;
+	int iStatus;
+	int i;
+	
+	do
+	{
+		iMaxNames *= 2;
+		free(szNameM);
+		szNameM = malloc(iMaxNames * sizeof(*szNameM));
+		if (szNameM == NULL)
+			ErrExit(ERR_ALGORITHM, "Unable to allocate memory");
+		iStatus = simQueryTrace(pLogFile, pIndexFile, iQueryTime
+			, szNameM, iMaxNames, &iPresentCnt);
+	} while (iStatus == SIM_ERR_FULL);
+	
+	if (iStatus == SIM_ERR_IO)
+		ErrExit(ERR_ALGORITHM, "Unable to read trace %s", pszTracePrefix);
+	if (iStatus == SIM_EMPTY)
+		ErrExit(ERR_BAD_INPUT, "Time %d is before trace %s starts"
+			, iQueryTime, pszTracePrefix);
+	
+	printf("%-5s %-20s %-15s\n", "Time", "Person", "Event");
+	printf("%-45s\n", "-----------------------------------");
+	for (i = 0; i < iPresentCnt; i++)
+		printf("%-5d %-20s %-15s\n", iQueryTime, szNameM[i], "Present");
+	printf("%-5d %-20s %-15d\n", iQueryTime, "OCCUPANTS", iPresentCnt);
+	
+	free(szNameM);
+	fclose(pLogFile);
+	fclose(pIndexFile);
+}
+
+/******************** processCommandSwitches *****************************
+void processCommandSwitches(int argc, char *argv[], int *piThreadCnt
+    , long *plBudgetKB, char **ppszTraceOut, char **ppszTraceIn, int *piQueryTime)
+Purpose:
+    Checks the syntax of command line arguments and returns the
+    requested options.  If an error is found, it exits with usage.
+Parameters:
+    I   int argc                  count of command line arguments
+    I   char *argv[]              array of command line arguments
+    O   int *piThreadCnt          number of worker threads (-t)
+    O   long *plBudgetKB          external queue memory budget (-m)
+    O   char **ppszTraceOut       prefix of the trace to write (-w)
+    O   char **ppszTraceIn        prefix of the trace to query (-r)
+    O   int *piQueryTime          time to query (-q)
+Notes:
+    -r and -q must be given together.
+    If a -? switch is passed, the usage is printed and the program exits
+    with USAGE_ONLY.
+**************************************************************************/
+void processCommandSwitches(int argc, char *argv[], int *piThreadCnt
+    , long *plBudgetKB, char **ppszTraceOut, char **ppszTraceIn, int *piQueryTime)
+{
+    int bQueryTime = FALSE;
+    int i;
+    
+    for (i = 1; i < argc; i++)
+    {
+        // check for a switch
+        if (argv[i][0] != '-')
+            exitUsage(i, ERR_EXPECTED_SWITCH, argv[i]);
+        // determine which switch it is
+        switch (argv[i][1])
+        {
+            case 't':                   // Thread count
+                if (++i >= argc)
+                    exitUsage(i, ERR_MISSING_ARGUMENT, argv[i - 1]);
+                *piThreadCnt = atoi(argv[i]);
+                if (*piThreadCnt < 1 || *piThreadCnt > MAX_THREADS)
+                    exitUsage(i, ERR_INVALID_THREADS, argv[i]);
+                break;
+            case 'm':                   // Memory budget for the external queue
+                if (++i >= argc)
+                    exitUsage(i, ERR_MISSING_ARGUMENT, argv[i - 1]);
+                *plBudgetKB = atol(argv[i]);
+                if (*plBudgetKB < EXT_MIN_BUDGET_KB)
+                    exitUsage(i, ERR_INVALID_BUDGET, argv[i]);
+                break;
+            case 'w':                   // Trace to write
+                if (++i >= argc)
+                    exitUsage(i, ERR_MISSING_ARGUMENT, argv[i - 1]);
+                *ppszTraceOut = argv[i];
+                break;
+            case 'r':                   // Trace to query
+                if (++i >= argc)
+                    exitUsage(i, ERR_MISSING_ARGUMENT, argv[i - 1]);
+                *ppszTraceIn = argv[i];
+                break;
+            case 'q':                   // Query time
+                if (++i >= argc)
+                    exitUsage(i, ERR_MISSING_ARGUMENT, argv[i - 1]);
+                *piQueryTime = atoi(argv[i]);
+                bQueryTime = TRUE;
+                break;
+            case '?':
+                exitUsage(USAGE_ONLY, "", "");
+                break;
+            default:
+                exitUsage(i, ERR_EXPECTED_SWITCH, argv[i]);
+        }
+    }
+    if (*ppszTraceIn != NULL && !bQueryTime)
+        exitUsage(USAGE_ERR, ERR_MISSING_SWITCH, "-q");
+    if (*ppszTraceIn == NULL && bQueryTime)
+        exitUsage(USAGE_ERR, ERR_MISSING_SWITCH, "-r");
+}
+
+int main(int argc, char *argv[])
 {
-	LinkedList list = newLinkedList();          // LinkedList
 	Simulation sim;                             // simulation
+	SimConfig config = {EQ_LINKED_LIST, 0, 0, 1, IDX_DEFAULT};  // simulation options
+	long lBudgetKB = 0;                         // -m external queue budget
+	char *pszTraceOut = NULL;                   // -w trace to write
+	char *pszTraceIn = NULL;                    // -r trace to query
+	int iQueryTime = 0;                         // -q time to query
+	FILE *pLogFile = NULL;                      // trace event log
+	FILE *pIndexFile = NULL;                    // trace snapshot index
+	static BatchLines lineM;                    // handler output
+	
+	processCommandSwitches(argc, argv, &config.iThreadCnt, &lBudgetKB
+		, &pszTraceOut, &pszTraceIn, &iQueryTime);
+	if (pszTraceIn != NULL)
+	{
+		queryTrace(pszTraceIn, iQueryTime);
+		return (EXIT_SUCCESS);
+	}
+	if (lBudgetKB > 0)
+	{
+		config.iBackend = EQ_EXTERNAL;
+		config.lBudgetBytes = lBudgetKB * 1024;
+	}
+	if (pszTraceOut != NULL)
+		config.iPersonIndex = IDX_ON;           // snapshots need the index
+	sim = simCreate(&config);
+	if (sim == NULL)
+		ErrExit(ERR_ALGORITHM, "Unable to create simulation");
+	simSetCallbacks(sim, formatEventNode, printEventLine, lineM);
+	if (pszTraceOut != NULL)
+	{
+		pLogFile = openTraceFile(pszTraceOut, ".trc", "wb");
+		pIndexFile = openTraceFile(pszTraceOut, ".idx", "wb");
+		if (simEnableTrace(sim, pLogFile, pIndexFile, TRACE_SNAPSHOT_EVENTS) != SIM_OK)
+			ErrExit(ERR_ALGORITHM, "Unable to write trace %s", pszTraceOut);
+	}
 	
-	// takes a line of text from stdin and stores it in LinkedList
-	readEventData(list);
+	// takes a line of text from stdin and schedules its events
+	readEventData(sim);
 	
-	// sim must be allocated here so function can point to 
-	// list properly
-	sim = newSim(list);         
 	runSimulation(sim, 1000);
 
 	// ensure memory is not leaked
-	freeLL(list);
-	free(sim);
+	simDestroy(sim);
+	if (pLogFile != NULL && (fclose(pLogFile) != 0 || fclose(pIndexFile) != 0))
+		ErrExit(ERR_ALGORITHM, "Unable to write trace %s", pszTraceOut);
 	
 	return (EXIT_SUCCESS);
 }
@@ -531,7 +510,8 @@ void exitUsage(int iArg, char *pszMessage, char *pszDiagnosticInfo)
                 , pszDiagnosticInfo);
     }
     // print the usage information for any type of command line error
-    fprintf(stderr, "p2 -c customerFileName -q queryFileName\n");
+    fprintf(stderr, "p3 [-t numThreads] [-m budgetKB] [-w tracePrefix] < inputFile\n");
+    fprintf(stderr, "p3 -r tracePrefix -q time\n");
     if (iArg == USAGE_ONLY)
         exit(USAGE_ONLY); 
     else 
@@ -1,29 +1,52 @@
 /**********************************************************************
 cs2123p3.h
 Purpose:
+    Includes cs2123p3sim.h (the public library interface, which defines
+    Person, Event and the event type constants).
     Defines constants:
         max constants
         error constants
-        event type constants
         boolean constants
     Defines typedef for
         Token
-        Person
-        Event (instead of Element)
         For Linked List
             NodeLL
             LinkedListImp
             LinkedList
+        For the Person Index
+            PendingLink
+            PersonEntry
+            IndexSlab
+            PersonIndexImp
+            PersonIndex
+        For the external-memory queue
+            ExtRecord
+            ExtRun
+            ExternalQueueImp
+            ExternalQueue
+        For the event queue
+            EventQueueImp
+            EventQueue
+        For the thread pool
+            ThreadPoolImp
+            ThreadPool
+        For the trace
+            TraceRecord
+            TraceIndexEntry
+            TraceNameSet
         For the simulation
-            SimulationImp
-            Simulation
+            SimulationImp (private structure behind Simulation)
     Protypes
+        Library internals (cs2123p3sim.c)
         Functions provided by student
         Other functions provided by Larry previously (program 2)
         Utility functions provided by Larry previously (program 2)
 Notes:
-
+    Only cs2123p3sim.c and the p3 program include this header; host
+    programs include cs2123p3sim.h.
 **********************************************************************/
+#include <pthread.h>
+#include "cs2123p3sim.h"
 
 /*** constants ***/
 // Maximum constants
@@ -31,6 +54,29 @@ Notes:
 #define MAX_TOKEN 50            // Maximum number of actual characters for a token
 #define MAX_LINE_SIZE 100       // Maximum number of character per input line
 
+// Person Index constants
+#define INDEX_INITIAL_BUCKETS 64   // initial number of hash buckets
+#define INDEX_MAX_LOAD        2    // entries per bucket before the table doubles
+#define INDEX_SLAB_ITEMS      1024 // entries or links allocated together
+
+// External-memory queue constants
+#define EXT_MERGE_FANIN     8         // runs of one level merged into one of the next
+#define EXT_MAX_LEVELS      8         // levels of runs; the top level merges into itself
+#define EXT_MAX_RUNS        ((EXT_MERGE_FANIN - 1) * EXT_MAX_LEVELS + 1)
+                                      // run slots: a full level of each plus a spill
+#define EXT_MIN_BUDGET_KB   4         // smallest -m memory budget in kilobytes
+#define EXT_MIN_NONE        -1        // findMinExternal: queue is empty
+#define EXT_MIN_HEAP        -2        // findMinExternal: heap top is earliest
+#define EXT_MIN_ERROR       -3        // findMinExternal: a run could not be read
+
+// Trace constants
+#define TRACE_EVENT         1      // TraceRecord of an event that was run
+#define TRACE_PRESENT       2      // TraceRecord of a person in a snapshot
+#define TRACE_SNAPSHOT_EVENTS 256  // events between snapshots written by -w
+
+// Thread pool constants
+#define MIN_PARALLEL_BATCH  2      // smaller batches are handled inline
+
 // Error constants (program exit values)
 #define ERR_COMMAND_LINE    900    // invalid command line argument
 #define ERR_ALGORITHM       903    // Error in algorithm - almost anything else
@@ -40,10 +86,9 @@ Notes:
 #define ERR_MISSING_SWITCH          "missing switch"
 #define ERR_EXPECTED_SWITCH         "expected switch, found"
 #define ERR_MISSING_ARGUMENT        "missing argument for"
-
-// Event Constants
-#define EVT_ARRIVE          1      // when a person arrives
-#define EVT_DEPART          2      // when a person departs the simulation 
+#define ERR_INVALID_THREADS         "number of threads must be 1 to 16, found"
+#define ERR_INVALID_BUDGET          "memory budget must be at least 4 KB, found"
+#define ERR_TRACE_FILE              "unable to open trace file"
 
 // exitUsage control 
 #define USAGE_ONLY          0      // user only requested usage information
@@ -58,22 +103,59 @@ Notes:
 // Token typedef used for operators, operands, and parentheses
 typedef char Token[MAX_TOKEN + 1];
 
-// Typedefs for the queues
-// Element typedef 
-typedef struct
+// Output lines of one batch: formatEventNode fills line iSlot and
+// printEventLine prints it
+typedef char BatchLines[MAX_BATCH_EVENTS][MAX_LINE_SIZE];
+
+// typedefs for the Person Index
+// One pending event of a person.  A person's links are kept in the order
+// the event queue will remove the events, so a removed event is found
+// at (or next to) the front.
+typedef struct PendingLink
+{
+    int iEventType;                     // EVT_ARRIVE or EVT_DEPART
+    int iTime;                          // time of the pending event
+    struct PendingLink *pNext;          // person's next pending event
+} PendingLink;
+
+// One entry per person currently referenced by the event queue.
+typedef struct PersonEntry
 {
-    char szName[12];       // Name
-    int iDepartUnits;      // time units representing how long he stays around
-} Person;
+    char szName[MAX_NAME_SIZE + 1];     // key: name of the person
+    PendingLink *pPendingHead;          // pending events, earliest first
+    int iArrivePending;                 // arrive events still in the queue
+    int iDepartPending;                 // depart events still in the queue
+    int iInside;                        // arrivals processed minus departures
+                                        // processed; > 0 means present
+    struct PersonEntry *pNextHash;      // next entry in the same bucket
+    struct PersonEntry *pPrevOccupant;  // occupant list (only when present)
+    struct PersonEntry *pNextOccupant;
+} PersonEntry;
+
+// Block of entries and links.  Allocating them in slabs keeps them out
+// of the way of the event queue's own nodes.
+typedef struct IndexSlab
+{
+    struct IndexSlab *pNext;        // slab allocated before this one
+    PersonEntry *entryM;            // entries of this slab, NULL if none
+    PendingLink *linkM;             // links of this slab, NULL if none
+} IndexSlab;
 
 typedef struct
 {
-    int iEventType;         // The type of event as an integer:
-                            //    EVT_ARRIVE - arrival event
-                            //    EVT_DEPART - departure event
-    int iTime;              // The time the event will occur 
-    Person person;          // The person invokved in the event.
-} Event;
+    PersonEntry **bucketM;          // array of hash bucket chains
+    int iBucketCnt;                 // number of buckets in bucketM
+    int iEntryCnt;                  // number of entries in all buckets
+    PersonEntry *pOccupantHead;     // people who arrived and have not departed
+    int iOccupantCnt;               // number of entries in the occupant list
+    IndexSlab *pSlabHead;           // every slab, freed by freePersonIndex
+    PersonEntry *pFreeEntry;        // unused entries, chained by pNextHash
+    PendingLink *pFreeLink;         // unused links, chained by pNext
+    int bFixedSize;                 // TRUE if every slab was allocated up
+                                    // front; the index never grows
+} PersonIndexImp;
+
+typedef PersonIndexImp *PersonIndex;
 
 // typedefs for the Linked Lists 
 typedef struct NodeLL
@@ -85,19 +167,144 @@ typedef struct NodeLL
 typedef struct
 {
     NodeLL *pHead;
+    NodeLL *poolM;      // preallocated nodes, NULL if malloc'd
+    NodeLL *pFree;      // unused nodes of poolM
 } LinkedListImp; 
 
 typedef LinkedListImp *LinkedList;
 
-// typedefs for the Simulation
+// typedefs for the external-memory queue
+// Records are ordered by iTime and, within a time, newest first (highest
+// lSeq) which is the order insertOrderedLL gives equal times.
 typedef struct
+{
+    Event event;
+    long lSeq;                  // insertion sequence number
+} ExtRecord;
+
+// A sorted run spilled to a temporary file and read back a block at a time
+typedef struct
+{
+    FILE *pFile;                // tmpfile() holding the run
+    long lRemaining;            // records still in the file
+    ExtRecord *bufferM;         // current block of the run
+    int iBufferCnt;             // records in bufferM
+    int iBufferPos;             // subscript of the run's next record
+    int iLevel;                 // times its records have been merged; a run
+                                // of level L holds about FANIN^L spills
+} ExtRun;
+
+typedef struct
+{
+    ExtRecord *heapM;           // min heap of records not yet spilled
+    int iHeapCnt;               // records in heapM
+    int iHeapMax;               // capacity of heapM
+    ExtRun runM[EXT_MAX_RUNS];  // spilled runs, merged lazily on remove
+    int iRunCnt;                // runs in runM
+    int iBlockRecords;          // records read per fread of a run
+    long lNextSeq;              // sequence number for the next insert
+    int bIOError;               // TRUE once a run file could not be used
+} ExternalQueueImp;
+
+typedef ExternalQueueImp *ExternalQueue;
+
+// typedefs for the event queue
+// Hides which backend holds the pending events and keeps the
+// person index current for every backend.
+typedef struct
+{
+    int iBackend;               // EQ_LINKED_LIST or EQ_EXTERNAL
+    int iMaxEvents;             // reserved capacity, 0 if unbounded
+    int iPendingCnt;            // events not yet committed, taken or not
+    LinkedList list;            // used by EQ_LINKED_LIST
+    ExternalQueue extQueue;     // used by EQ_EXTERNAL
+    PersonIndex personIndex;    // person -> pending events, NULL if off
+} EventQueueImp;
+
+typedef EventQueueImp *EventQueue;
+
+// typedefs for the thread pool
+// Workers run the EventHandler of one same-time batch; the caller then
+// runs the EventCallback in batch order.
+typedef struct
+{
+    pthread_t threadM[MAX_THREADS];
+    int iThreadCnt;             // number of worker threads started
+    pthread_mutex_t lock;       // protects every field below
+    pthread_cond_t workReady;   // signaled when a new batch is posted
+    pthread_cond_t workDone;    // signaled when the last handler finishes
+    Event *eventM;              // batch being handled
+    EventHandler handler;       // run for each event of the batch
+    void *pContext;             // passed to handler
+    int iBatchCnt;              // number of events in the batch
+    int iNextEvent;             // next subscript for a worker to claim
+    int iDoneCnt;               // number of handlers finished
+    int iGeneration;            // incremented for each posted batch
+    int bShutdown;              // TRUE tells the workers to exit
+} ThreadPoolImp;
+
+typedef ThreadPoolImp *ThreadPool;
+
+// typedefs for the trace
+// The log is a sequence of TraceRecords: every event run, in order, with
+// a block of TRACE_PRESENT records (one per person present) written
+// before the events of each snapshot's time.
+typedef struct
+{
+    int iRecordType;            // TRACE_EVENT or TRACE_PRESENT
+    int bPresent;               // TRUE if the person is present once
+                                // every event up to event.iTime has run
+    Event event;                // event run; for TRACE_PRESENT only
+                                // iTime and person.szName are used
+} TraceRecord;
+
+// The index is a sequence of fixed-size entries in increasing iTime, so
+// a query can binary search it with fseek.
+typedef struct
+{
+    int iTime;                  // snapshot holds every event before iTime
+                                // and none at or after it
+    int iPresentCnt;            // TRACE_PRESENT records in the block
+    long lSnapshotOffset;       // log offset of the TRACE_PRESENT block;
+                                // the tail of events follows the block
+} TraceIndexEntry;
+
+// People present during a query: the caller's name array plus chained
+// hash buckets of subscripts into it, so a name is found without a
+// linear search.
+typedef struct
+{
+    char (*szNameM)[MAX_NAME_SIZE + 1];  // names, in no particular order
+    int iMaxNames;              // names szNameM can hold
+    int iNameCnt;               // names in szNameM
+    int *bucketM;               // first subscript of each chain, -1 if none
+    int *nextM;                 // next subscript in the same chain, -1 if none
+    int iBucketCnt;             // power of two
+} TraceNameSet;
+
+// typedefs for the Simulation
+// Simulation itself is declared in cs2123p3sim.h as a pointer to this.
+typedef struct SimulationImp
 {
     int iClock;         // clock time
-    LinkedList eventList;
+    EventQueue eventQueue;
+    ThreadPool pool;    // runs same-time batches in parallel, NULL if sequential
+    EventHandler handler;       // NULL if not registered
+    EventCallback callback;     // NULL if not registered
+    void *pContext;             // passed to handler and callback
+    Event batchM[MAX_BATCH_EVENTS];     // events of the current batch
+    int iBatchCnt;              // events of batchM that will be committed
+    int iCommitCnt;             // events of batchM committed so far
+    int bRunning;               // TRUE while processEvents runs callbacks
+    FILE *pTraceLog;            // trace event log, NULL if not tracing
+    FILE *pTraceIndex;          // trace snapshot index
+    int iSnapshotEvents;        // events to trace between snapshots
+    int iSinceSnapshot;         // events traced since the last snapshot
+    int iLastTraceTime;         // time of the last event traced
 } SimulationImp;
-typedef SimulationImp *Simulation;
 
 /**********   prototypes ***********/
+// defined in cs2123p3sim.c (through "simulation library internals")
 
 // linked list functions - you must provide the code for these (see course notes)
 int removeLL(LinkedList list, Event  *pValue);
@@ -105,18 +312,90 @@ NodeLL *insertOrderedLL(LinkedList list, Event value);
 NodeLL *searchLL(LinkedList list, int match, NodeLL **ppPrecedes);
 LinkedList newLinkedList();
 NodeLL *allocateNodeLL(LinkedList list, Event value);
+int reserveNodesLL(LinkedList list, int iMaxNodes);
+void freeLL(LinkedList list);
+
+// event queue functions
+EventQueue newEventQueue(int iBackend, long lBudgetBytes, int iMaxEvents
+    , int bPersonIndex);
+void freeEventQueue(EventQueue queue);
+int insertEventQ(EventQueue queue, Event value);
+int removeEventQ(EventQueue queue, Event *pValue);
+int takeEventQ(EventQueue queue, Event *pValue);
+void commitEventQ(EventQueue queue, Event value);
+int restoreEventQ(EventQueue queue, Event value);
+int peekEventQ(EventQueue queue, Event *pValue);
+int removeBatchEventQ(EventQueue queue, Event eventM[], int iMaxEvents);
+
+// external-memory queue functions
+ExternalQueue newExternalQueue(long lBudgetBytes);
+void freeExternalQueue(ExternalQueue extQueue);
+int insertExternal(ExternalQueue extQueue, Event value);
+int removeExternal(ExternalQueue extQueue, Event *pValue);
+int peekExternal(ExternalQueue extQueue, Event *pValue);
+int compareExtRecord(const void *pLeft, const void *pRight);
+int spillExternal(ExternalQueue extQueue);
+int mergeExternalRuns(ExternalQueue extQueue, int iLevel);
+ExtRecord *headOfRun(ExternalQueue extQueue, ExtRun *pRun);
+int findMinExternal(ExternalQueue extQueue);
+int findMinRun(ExternalQueue extQueue, int iFirst);
 
+// person index functions - kept current by insertEventQ and commitEventQ
+PersonIndex newPersonIndex(int iMaxEntries);
+void freePersonIndex(PersonIndex index);
+PersonEntry *lookupPerson(PersonIndex index, char szName[]);
+int getOccupantCount(PersonIndex index);
+int getOccupants(PersonIndex index, PersonEntry *entryM[], int iMaxEntries);
+int indexInsertEvent(PersonIndex index, Event value);
+void indexRemoveEvent(PersonIndex index, Event value);
+void indexUndoInsert(PersonIndex index, Event value);
+PersonEntry **findPersonLink(PersonIndex index, char szName[]);
+void releasePersonEntry(PersonIndex index, PersonEntry **ppLink);
+void removePendingLink(PersonIndex index, PersonEntry *pEntry, Event value);
+unsigned int hashPersonName(char szName[]);
+void growPersonIndex(PersonIndex index);
+int addIndexSlab(PersonIndex index, int iEntryCnt, int iLinkCnt);
+PersonEntry *allocatePersonEntry(PersonIndex index);
+PendingLink *allocatePendingLink(PersonIndex index);
+
+// thread pool functions
+ThreadPool newThreadPool(int iThreadCnt);
+void freeThreadPool(ThreadPool pool);
+void runBatch(ThreadPool pool, EventHandler handler, void *pContext
+    , Event eventM[], int iBatchCnt);
+void *workerThread(void *pArg);
+
+// simulation library internals
+int processEvents(Simulation sim, int iMaxEvents, int iUntilTime);
+int cutBatch(Simulation sim);
+
+// trace functions
+int writeTraceSnapshot(Simulation sim, int iTime);
+int writeTraceEvents(Simulation sim, Event eventM[], int iEventCnt);
+int findTraceSnapshot(FILE *pIndexFile, int iTime, TraceIndexEntry *pEntry);
+int applyTraceRecord(TraceRecord *pRecord, TraceNameSet *pSet);
+int addTraceName(TraceNameSet *pSet, char szName[]);
+int *findTraceLink(TraceNameSet *pSet, char szName[]);
+void removeTraceName(TraceNameSet *pSet, int *pLink);
+
+// defined in cs2123p3.c
 // functions coded by me to increase program modularity
-void addEventNodes(LinkedList list, char szPersonName[], int iDepUnits, int iArriveTime);
-int readEventData(LinkedList list);
+void addEventNodes(Simulation sim, char szPersonName[], int iDepUnits, int iArriveTime);
+int readEventData(Simulation sim);
 void printLL(LinkedList list);
-Simulation newSim(LinkedList list);
-void freeLL(LinkedList list);
 void printEventNode(Event printEvent);
+void formatEventNode(Event event, int iSlot, void *pContext);
+void printEventLine(Event event, int iSlot, void *pContext);
 
 // simulation functions - you must provide code for this
 void runSimulation(Simulation simulation, int iTimeLimit);
 
+// command line functions
+void processCommandSwitches(int argc, char *argv[], int *piThreadCnt
+    , long *plBudgetKB, char **ppszTraceOut, char **ppszTraceIn, int *piQueryTime);
+FILE *openTraceFile(char *pszPrefix, char *pszSuffix, char *pszMode);
+void queryTrace(char *pszTracePrefix, int iQueryTime);
+
 // functions in most programs, but require modifications
 void exitUsage(int iArg, char *pszMessage, char *pszDiagnosticInfo);
 
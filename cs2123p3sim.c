@@ -0,0 +1,2534 @@
+/**********************************************************************
+cs2123p3sim.c by Timothy Hennessy
+Purpose:
+    Event simulation library.  Holds the pending events in an event
+    queue (in-memory linked list or external-memory heap), keeps a
+    person index for occupancy queries, and runs the events through
+    host callbacks behind the opaque Simulation handle declared in
+    cs2123p3sim.h.  Optionally traces the run to a seekable event log
+    with a sparse snapshot index for "who was present at time T" queries.
+Notes:
+    1.  No function in this file prints or calls exit; failures are
+        returned as SIM_ERR_* values (or NULL from constructors).
+    2.  When SimConfig.iMaxEvents is given, linked list nodes and person
+        entries come from pools allocated by simCreate, so scheduling and
+        running events never allocate.  The exception is EQ_EXTERNAL,
+        whose spills and merges each open a tmpfile().  Run files are
+        not opened ahead of time because how many are needed depends on
+        the number of events.
+    3.  Compile with -pthread.
+**********************************************************************/
+
+/* include files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include "cs2123p3.h"
+
+// linked list functions - you must provide the code for these (see course notes)
+/******************** removeLL *************************************
+int removeLL(LinkedList list, Event  *pValue)
+Purpose:
+    Removes a node from the front of a LinkedList and returns the
+    Event structure (via the parameter list).
+Parameters:
+    I   LinkedList list       pointer to the LinkedList
+    I   Event *pValue         value structure of node being removed
+
+Returns:
+  Functionally
+      TRUE  - LinkedList was not empty
+      FALSE - LinkedList was passed in empty
+  Parameter
+      Event structure containing value of node which was removed
+
+Notes:
+  Removes the first node from the linked list.  Returns the nodes event
+  value via the parameter list.  Sets list->pHead to list->pHead->pNext.
+**************************************************************************/
+int removeLL(LinkedList list, Event *pValue)
+{
+	NodeLL *pRemove;
+	if (list->pHead == NULL)
+		return FALSE;                   // list was passed in empty
+	*pValue = list->pHead->event;       // store Event structure into pValue
+	                                    // so it can be returned via param
+	pRemove = list->pHead;              // set the address of p to first 
+	                                    // node in LinkedList
+	list->pHead = list->pHead->pNext;   // new first node in LinkedList
+	if (list->poolM != NULL)
+	{
+		pRemove->pNext = list->pFree;   // back to the reserved nodes
+		list->pFree = pRemove;
+	}
+	else
+		free(pRemove);
+	return TRUE;                        // successfully removed a node
+}
+/******************** allocateNodeLL *************************************
+NodeLL *allocateNodeLL(LinkedList list, Event value)
+Purpose:
+    Allocates new node for LinkedList.
+Parameters:
+    I   LinkedList list       pointer to the LinkedList
+    I   Event value           values to be given to new node
+
+Returns:
+  A pointer to the new node.
+  NULL if memory is unavailable (or the reserved nodes are used up).
+
+Notes:
+  Takes the node from the list's reserved nodes when reserveNodesLL
+  was called; otherwise the node is dynamically allocated.
+**************************************************************************/
+NodeLL *allocateNodeLL(LinkedList list, Event value)
+{
+	NodeLL *pNew;
+	if (list->poolM != NULL)
+	{
+		pNew = list->pFree;
+		if (pNew != NULL)
+			list->pFree = pNew->pNext;
+	}
+	else
+		pNew = (NodeLL *) malloc(sizeof(NodeLL));
+	if (pNew == NULL)
+		return NULL;
+	pNew->event = value;
+	pNew->pNext = NULL;
+	return pNew;
+}
+/******************** searchLL *******************************************
+NodeLL *searchLL(LinkedList list, int match, NodeLL **ppPrecedes)
+Purpose:
+    Uses match (from argument passed in to function via parameter)
+    to iterate over linked list and find if a NodeLL contains a matching
+    value.
+Parameters:
+    I   LinkedList list       pointer to the LinkedList
+    I   int   match           stores value to be found in LinkedList
+    O   NodeLL ppPrecedes     pointer to a pointer to a NodeLL; used 
+                              to return the address of the NodeLL found
+                              right before the matching NodeLL
+
+Returns:
+  Functionally
+    NULL    - If a match is not found in LinkedList
+    Address - The address of the match in LinkedList
+  Parameter
+    ppPrecedes - returns address of previous NodeLL
+Notes:
+                               Values Returned
+  Condition                    Functionally         Via Param
+  Match at beginning           ppPrecedes = NULL    p = pHead
+  Match Less than first Node   ppPrecedes = NULL    p = NULL
+  Match between Nodes          ppPrecedes = p       p = p->pNext
+  List is empty                ppPrecedes = NULL    p = NULL
+  Match is less than           ppPrecedes = p       p = p->pNext
+  (between nodes)
+**************************************************************************/
+NodeLL *searchLL(LinkedList list, int match, NodeLL **ppPrecedes)
+{
+	NodeLL *pCurrent;
+	// used when the list is empty or we need to insert at the beginning
+	*ppPrecedes = NULL;
+	
+	// Traverse through the list loooking for where the key belongs or
+	// the end of the list.
+	for (pCurrent = list->pHead; pCurrent != NULL; pCurrent = pCurrent->pNext)
+	{
+		if (match == pCurrent->event.iTime)     // assume match is an integer
+			return pCurrent;
+		if (match < pCurrent->event.iTime)      // assume the LL is ordered
+			return NULL;
+		*ppPrecedes = pCurrent;                 // pointer to a NodeLL
+	}
+	// Not found return NULL
+	return NULL;
+}
+/******************** insertOrderedLL *************************************
+NodeLL *insertOrderedLL(LinkedList list, Event value)
+Purpose:
+    Inserts a NodeLL into its respective place in the ordered
+    LinkedList.
+Parameters:
+    I   LinkedList list       pointer to the LinkedList
+    I   Event value           ??
+
+Returns:
+  A pointer to the new node.
+  NULL if a node could not be allocated; the list is unchanged.
+
+Notes:
+  ?
+Update so it can add events with the same time value
+**************************************************************************/
+NodeLL *insertOrderedLL(LinkedList list, Event value)
+{
+	NodeLL *pNew;
+	NodeLL *pFind;
+	NodeLL *pPrecedes;
+	// see if it already exists
+	// pFind is not necessary unless we are concerned
+    // about duplicates
+	pFind = searchLL(list, value.iTime, &pPrecedes);
+	// commented out code to allow for duplicates
+	//if (pFind != NULL)
+	//	return pFind;
+	
+	// Allocate a node and insert.
+	pNew = allocateNodeLL(list, value);
+	if (pNew == NULL)
+		return NULL;
+	
+	// Check for inserting at the beginning of the list
+	// this will also handle when the list is empty
+	if (pPrecedes == NULL)
+	{
+		pNew->pNext = list->pHead;
+		list->pHead = pNew;
+	}
+	else
+	{
+		pNew->pNext = pPrecedes->pNext;
+		pPrecedes->pNext = pNew;
+	}
+	return pNew;
+}
+/******************** newLinkedList **************************************
+LinkedList newLinkedList(void)
+Purpose:
+    Dynamically allocates memory for a new linked list.
+Parameters:
+    O   LinkedList list       pointer to a LinkedListImp
+
+Returns:
+    A pointer to a LinkedListImp structure (the pointer is called 
+    list) that has a pointer (called pHead) to a NodeLL initialized to NULL.
+    NULL if memory is unavailable.
+Notes:
+    ?
+**************************************************************************/
+LinkedList newLinkedList()
+{
+	LinkedList list = (LinkedList) malloc(sizeof(LinkedListImp));
+	
+	if (list == NULL)
+		return NULL;
+	// Mark the list as empty
+	list->pHead = NULL;      // empty list
+	list->poolM = NULL;      // nodes are malloc'd until reserveNodesLL
+	list->pFree = NULL;
+	return list;
+}
+/******************** reserveNodesLL *************************************
+int reserveNodesLL(LinkedList list, int iMaxNodes)
+Purpose:
+    Allocates every node the list will ever use in one block.
+Parameters:
+    I/O LinkedList list       pointer to an empty LinkedList
+    I   int iMaxNodes         maximum number of nodes in the list
+
+Returns:
+    TRUE  - nodes were reserved
+    FALSE - memory is unavailable; the list still uses malloc
+Notes:
+    After this, allocateNodeLL and removeLL reuse the reserved nodes and
+    never call malloc or free.  freeLL frees the block.
+**************************************************************************/
+int reserveNodesLL(LinkedList list, int iMaxNodes)
+{
+	int i;
+	
+	list->poolM = (NodeLL *) malloc(iMaxNodes * sizeof(NodeLL));
+	if (list->poolM == NULL)
+		return FALSE;
+	// chain every node onto the free list
+	list->pFree = NULL;
+	for (i = iMaxNodes - 1; i >= 0; i--)
+	{
+		list->poolM[i].pNext = list->pFree;
+		list->pFree = &list->poolM[i];
+	}
+	return TRUE;
+}
+// end of functions from notes
+// begin person index functions
+/******************** hashPersonName *************************************
+unsigned int hashPersonName(char szName[])
+Purpose:
+    Computes the hash value of a person's name.
+Parameters:
+    I   char szName[]         name of the person
+
+Returns:
+    An unsigned hash value (djb2) of at most MAX_NAME_SIZE characters.
+Notes:
+    The caller reduces the value modulo the number of buckets.
+**************************************************************************/
+unsigned int hashPersonName(char szName[])
+{
+	unsigned int uiHash = 5381;
+	int i;
+	
+	for (i = 0; i < MAX_NAME_SIZE && szName[i] != '\0'; i++)
+		uiHash = uiHash * 33 + (unsigned char) szName[i];
+	return uiHash;
+}
+/******************** newPersonIndex *************************************
+PersonIndex newPersonIndex(int iMaxEntries)
+Purpose:
+    Dynamically allocates an empty person index.
+Parameters:
+    I   int iMaxEntries       > 0 - preallocate this many entries and
+                                    enough buckets that the table never
+                                    grows
+                              0   - allocate entries as people appear
+
+Returns:
+    A pointer to a PersonIndexImp with empty buckets and an empty
+    occupant list.
+    NULL if memory is unavailable.
+Notes:
+    iMaxEntries also reserves one PendingLink per event, since each
+    pending event holds one.
+**************************************************************************/
+PersonIndex newPersonIndex(int iMaxEntries)
+{
+	PersonIndex index = (PersonIndex) malloc(sizeof(PersonIndexImp));
+	
+	if (index == NULL)
+		return NULL;
+	index->iBucketCnt = INDEX_INITIAL_BUCKETS;
+	while (index->iBucketCnt * INDEX_MAX_LOAD < iMaxEntries)
+		index->iBucketCnt *= 2;
+	index->bucketM = (PersonEntry **) calloc(index->iBucketCnt
+		, sizeof(PersonEntry *));
+	index->pSlabHead = NULL;
+	index->pFreeEntry = NULL;
+	index->pFreeLink = NULL;
+	index->bFixedSize = FALSE;
+	index->iEntryCnt = 0;
+	index->pOccupantHead = NULL;
+	index->iOccupantCnt = 0;
+	if (index->bucketM == NULL
+		|| (iMaxEntries > 0 && !addIndexSlab(index, iMaxEntries, iMaxEntries)))
+	{
+		freePersonIndex(index);
+		return NULL;
+	}
+	index->bFixedSize = (iMaxEntries > 0);
+	return index;
+}
+/******************** freePersonIndex ************************************
+void freePersonIndex(PersonIndex index)
+Purpose:
+    Frees every entry in the person index, the buckets and the index.
+Parameters:
+    I   PersonIndex index     pointer to the PersonIndexImp
+
+Returns:
+    N/A
+Notes:
+    Entries and links are freed a slab at a time.
+**************************************************************************/
+void freePersonIndex(PersonIndex index)
+{
+	IndexSlab *pSlab;
+	IndexSlab *pNext;
+	
+	for (pSlab = index->pSlabHead; pSlab != NULL; pSlab = pNext)
+	{
+		pNext = pSlab->pNext;
+		free(pSlab->entryM);
+		free(pSlab->linkM);
+		free(pSlab);
+	}
+	free(index->bucketM);
+	free(index);
+}
+/******************** addIndexSlab ***************************************
+int addIndexSlab(PersonIndex index, int iEntryCnt, int iLinkCnt)
+Purpose:
+    Allocates a slab of entries and links and puts them on the free
+    lists.
+Parameters:
+    I/O PersonIndex index     pointer to the PersonIndexImp
+    I   int iEntryCnt         number of PersonEntry to allocate
+    I   int iLinkCnt          number of PendingLink to allocate
+
+Returns:
+    TRUE  - the slab was added
+    FALSE - memory is unavailable; the free lists are unchanged
+Notes:
+    The entries are not calloc'd one at a time, so they do not end up
+    between the nodes of the event queue and slow down its walks.
+**************************************************************************/
+int addIndexSlab(PersonIndex index, int iEntryCnt, int iLinkCnt)
+{
+	IndexSlab *pSlab = (IndexSlab *) malloc(sizeof(IndexSlab));
+	int i;
+	
+	if (pSlab == NULL)
+		return FALSE;
+	pSlab->entryM = NULL;
+	pSlab->linkM = NULL;
+	if (iEntryCnt > 0)
+		pSlab->entryM = (PersonEntry *) malloc(iEntryCnt * sizeof(PersonEntry));
+	if (iLinkCnt > 0)
+		pSlab->linkM = (PendingLink *) malloc(iLinkCnt * sizeof(PendingLink));
+	if ((iEntryCnt > 0 && pSlab->entryM == NULL)
+		|| (iLinkCnt > 0 && pSlab->linkM == NULL))
+	{
+		free(pSlab->entryM);
+		free(pSlab->linkM);
+		free(pSlab);
+		return FALSE;
+	}
+	for (i = iEntryCnt - 1; i >= 0; i--)
+	{
+		pSlab->entryM[i].pNextHash = index->pFreeEntry;
+		index->pFreeEntry = &pSlab->entryM[i];
+	}
+	for (i = iLinkCnt - 1; i >= 0; i--)
+	{
+		pSlab->linkM[i].pNext = index->pFreeLink;
+		index->pFreeLink = &pSlab->linkM[i];
+	}
+	pSlab->pNext = index->pSlabHead;
+	index->pSlabHead = pSlab;
+	return TRUE;
+}
+/******************** allocatePersonEntry ********************************
+PersonEntry *allocatePersonEntry(PersonIndex index)
+Purpose:
+    Takes an entry off the free list, adding a slab if it is empty.
+Parameters:
+    I/O PersonIndex index     pointer to the PersonIndexImp
+
+Returns:
+    A pointer to the entry (not initialized).
+    NULL if the reserved entries are used up or memory is unavailable.
+Notes:
+    A fixed size index never adds a slab.
+**************************************************************************/
+PersonEntry *allocatePersonEntry(PersonIndex index)
+{
+	PersonEntry *pEntry;
+	
+	if (index->pFreeEntry == NULL
+		&& (index->bFixedSize || !addIndexSlab(index, INDEX_SLAB_ITEMS, 0)))
+		return NULL;
+	pEntry = index->pFreeEntry;
+	index->pFreeEntry = pEntry->pNextHash;
+	return pEntry;
+}
+/******************** allocatePendingLink ********************************
+PendingLink *allocatePendingLink(PersonIndex index)
+Purpose:
+    Takes a link off the free list, adding a slab if it is empty.
+Parameters:
+    I/O PersonIndex index     pointer to the PersonIndexImp
+
+Returns:
+    A pointer to the link (not initialized).
+    NULL if the reserved links are used up or memory is unavailable.
+Notes:
+    A fixed size index never adds a slab.
+**************************************************************************/
+PendingLink *allocatePendingLink(PersonIndex index)
+{
+	PendingLink *pLink;
+	
+	if (index->pFreeLink == NULL
+		&& (index->bFixedSize || !addIndexSlab(index, 0, INDEX_SLAB_ITEMS)))
+		return NULL;
+	pLink = index->pFreeLink;
+	index->pFreeLink = pLink->pNext;
+	return pLink;
+}
+/******************** lookupPerson ***************************************
+PersonEntry *lookupPerson(PersonIndex index, char szName[])
+Purpose:
+    Finds the index entry for a person.
+Parameters:
+    I   PersonIndex index     pointer to the PersonIndexImp
+    I   char szName[]         name of the person
+
+Returns:
+    NULL    - the person has no pending events and is not present
+    Address - the entry holding the person's pending events; the
+              person is still here when iInside > 0
+Notes:
+    Expected O(1); the table doubles before chains grow past
+    INDEX_MAX_LOAD entries on average.
+**************************************************************************/
+PersonEntry *lookupPerson(PersonIndex index, char szName[])
+{
+	PersonEntry *pEntry;
+	unsigned int uiBucket = hashPersonName(szName) % index->iBucketCnt;
+	
+	for (pEntry = index->bucketM[uiBucket]; pEntry != NULL; pEntry = pEntry->pNextHash)
+	{
+		if (strncmp(pEntry->szName, szName, MAX_NAME_SIZE) == 0)
+			return pEntry;
+	}
+	return NULL;
+}
+/******************** getOccupantCount **********************************
+int getOccupantCount(PersonIndex index)
+Purpose:
+    Returns the number of people who have arrived and not yet departed.
+Parameters:
+    I   PersonIndex index     pointer to the PersonIndexImp
+
+Returns:
+    The occupant count.
+Notes:
+    O(1); the count is maintained as events are removed.
+**************************************************************************/
+int getOccupantCount(PersonIndex index)
+{
+	return index->iOccupantCnt;
+}
+/******************** getOccupants **************************************
+int getOccupants(PersonIndex index, PersonEntry *entryM[], int iMaxEntries)
+Purpose:
+    Lists the people who have arrived and not yet departed.
+Parameters:
+    I   PersonIndex index     pointer to the PersonIndexImp
+    O   PersonEntry *entryM[] returned entries of the current occupants
+    I   int iMaxEntries       number of elements available in entryM
+
+Returns:
+    The number of entries returned in entryM.
+Notes:
+    O(k) in the number of occupants; walks the occupant list only.
+**************************************************************************/
+int getOccupants(PersonIndex index, PersonEntry *entryM[], int iMaxEntries)
+{
+	PersonEntry *pEntry;
+	int iCnt = 0;
+	
+	for (pEntry = index->pOccupantHead
+		; pEntry != NULL && iCnt < iMaxEntries
+		; pEntry = pEntry->pNextOccupant)
+	{
+		entryM[iCnt++] = pEntry;
+	}
+	return iCnt;
+}
+/******************** growPersonIndex ************************************
+void growPersonIndex(PersonIndex index)
+Purpose:
+    Doubles the number of buckets and rehashes every entry.
+Parameters:
+    I/O PersonIndex index     pointer to the PersonIndexImp
+
+Returns:
+    N/A
+Notes:
+    Entries are relinked, not copied, so PersonEntry addresses and the
+    occupant list stay valid.  If memory is unavailable the table keeps
+    its size and the chains just get longer.
+**************************************************************************/
+void growPersonIndex(PersonIndex index)
+{
+	PersonEntry **newBucketM;
+	PersonEntry *pEntry;
+	PersonEntry *pNext;
+	int iNewCnt = index->iBucketCnt * 2;
+	unsigned int uiBucket;
+	int i;
+	
+	newBucketM = (PersonEntry **) calloc(iNewCnt, sizeof(PersonEntry *));
+	if (newBucketM == NULL)
+		return;
+	for (i = 0; i < index->iBucketCnt; i++)
+	{
+		for (pEntry = index->bucketM[i]; pEntry != NULL; pEntry = pNext)
+		{
+			pNext = pEntry->pNextHash;
+			uiBucket = hashPersonName(pEntry->szName) % iNewCnt;
+			pEntry->pNextHash = newBucketM[uiBucket];
+			newBucketM[uiBucket] = pEntry;
+		}
+	}
+	free(index->bucketM);
+	index->bucketM = newBucketM;
+	index->iBucketCnt = iNewCnt;
+}
+/******************** indexInsertEvent ***********************************
+int indexInsertEvent(PersonIndex index, Event value)
+Purpose:
+    Records an event that was just added to the event queue.
+Parameters:
+    I/O PersonIndex index     pointer to the PersonIndexImp
+    I   Event value           event added to the queue
+
+Returns:
+    TRUE  - the event was recorded
+    FALSE - no entry or link could be allocated
+Notes:
+    Creates the person's entry on first reference.  The link goes before
+    the person's pending events at the same time, since the queue removes
+    the newest of those first.  Called by insertEventQ; constant expected
+    cost per event (a person rarely has more than a visit pending).
+**************************************************************************/
+int indexInsertEvent(PersonIndex index, Event value)
+{
+	PersonEntry *pEntry = lookupPerson(index, value.person.szName);
+	PendingLink *pLink = allocatePendingLink(index);
+	PendingLink **ppLink;
+	unsigned int uiBucket;
+	
+	if (pLink == NULL)
+		return FALSE;
+	if (pEntry == NULL)
+	{
+		if (!index->bFixedSize && index->iEntryCnt >= index->iBucketCnt * INDEX_MAX_LOAD)
+			growPersonIndex(index);
+		pEntry = allocatePersonEntry(index);
+		if (pEntry == NULL)
+		{
+			pLink->pNext = index->pFreeLink;
+			index->pFreeLink = pLink;
+			return FALSE;
+		}
+		memset(pEntry, 0, sizeof(PersonEntry));
+		memcpy(pEntry->szName, value.person.szName, sizeof(pEntry->szName));
+		uiBucket = hashPersonName(pEntry->szName) % index->iBucketCnt;
+		pEntry->pNextHash = index->bucketM[uiBucket];
+		index->bucketM[uiBucket] = pEntry;
+		index->iEntryCnt++;
+	}
+	pLink->iEventType = value.iEventType;
+	pLink->iTime = value.iTime;
+	for (ppLink = &pEntry->pPendingHead
+		; *ppLink != NULL && (*ppLink)->iTime < value.iTime
+		; ppLink = &(*ppLink)->pNext)
+		;
+	pLink->pNext = *ppLink;
+	*ppLink = pLink;
+	if (value.iEventType == EVT_ARRIVE)
+		pEntry->iArrivePending++;
+	else
+		pEntry->iDepartPending++;
+	return TRUE;
+}
+/******************** indexRemoveEvent ***********************************
+void indexRemoveEvent(PersonIndex index, Event value)
+Purpose:
+    Records an event that was just removed from the event queue and
+    updates the person's presence.
+Parameters:
+    I/O PersonIndex index     pointer to the PersonIndexImp
+    I   Event value           event removed from the queue
+
+Returns:
+    N/A
+Notes:
+    A removed arrive puts the person on the occupant list while a depart
+    is pending; a removed depart takes them off.  The entry is released
+    once the person has nothing pending and is not present.  Called by
+    commitEventQ; constant expected cost per event.
+**************************************************************************/
+void indexRemoveEvent(PersonIndex index, Event value)
+{
+	PersonEntry **ppLink = findPersonLink(index, value.person.szName);
+	PersonEntry *pEntry = *ppLink;
+	
+	if (pEntry == NULL)
+		return;                       // event was queued before indexing
+	
+	removePendingLink(index, pEntry, value);
+	if (value.iEventType == EVT_ARRIVE)
+	{
+		pEntry->iArrivePending--;
+		// only counts as present if the departure is still to come
+		if (pEntry->iDepartPending > 0 && pEntry->iInside++ == 0)
+		{
+			pEntry->pPrevOccupant = NULL;
+			pEntry->pNextOccupant = index->pOccupantHead;
+			if (index->pOccupantHead != NULL)
+				index->pOccupantHead->pPrevOccupant = pEntry;
+			index->pOccupantHead = pEntry;
+			index->iOccupantCnt++;
+		}
+	}
+	else
+	{
+		pEntry->iDepartPending--;
+		if (pEntry->iInside > 0 && --pEntry->iInside == 0)
+		{
+			if (pEntry->pPrevOccupant != NULL)
+				pEntry->pPrevOccupant->pNextOccupant = pEntry->pNextOccupant;
+			else
+				index->pOccupantHead = pEntry->pNextOccupant;
+			if (pEntry->pNextOccupant != NULL)
+				pEntry->pNextOccupant->pPrevOccupant = pEntry->pPrevOccupant;
+			index->iOccupantCnt--;
+		}
+	}
+	
+	releasePersonEntry(index, ppLink);
+}
+/******************** indexUndoInsert ************************************
+void indexUndoInsert(PersonIndex index, Event value)
+Purpose:
+    Reverses indexInsertEvent for an event the queue could not accept.
+Parameters:
+    I/O PersonIndex index     pointer to the PersonIndexImp
+    I   Event value           event that was not added
+
+Returns:
+    N/A
+Notes:
+    The person's presence is not changed.
+**************************************************************************/
+void indexUndoInsert(PersonIndex index, Event value)
+{
+	PersonEntry **ppLink = findPersonLink(index, value.person.szName);
+	
+	if (*ppLink == NULL)
+		return;
+	removePendingLink(index, *ppLink, value);
+	if (value.iEventType == EVT_ARRIVE)
+		(*ppLink)->iArrivePending--;
+	else
+		(*ppLink)->iDepartPending--;
+	releasePersonEntry(index, ppLink);
+}
+/******************** findPersonLink *************************************
+PersonEntry **findPersonLink(PersonIndex index, char szName[])
+Purpose:
+    Finds the link (bucket head or pNextHash) that points to a person's
+    entry so the entry can be unlinked.
+Parameters:
+    I   PersonIndex index     pointer to the PersonIndexImp
+    I   char szName[]         name of the person
+
+Returns:
+    Address of the link; the link is NULL if the person has no entry.
+Notes:
+    N/A
+**************************************************************************/
+PersonEntry **findPersonLink(PersonIndex index, char szName[])
+{
+	PersonEntry **ppLink;
+	unsigned int uiBucket = hashPersonName(szName) % index->iBucketCnt;
+	
+	for (ppLink = &index->bucketM[uiBucket]; *ppLink != NULL; ppLink = &(*ppLink)->pNextHash)
+	{
+		if (strncmp((*ppLink)->szName, szName, MAX_NAME_SIZE) == 0)
+			break;
+	}
+	return ppLink;
+}
+/******************** releasePersonEntry *********************************
+void releasePersonEntry(PersonIndex index, PersonEntry **ppLink)
+Purpose:
+    Unlinks and releases an entry once there is nothing left to answer
+    for the person: no pending events and not present.
+Parameters:
+    I/O PersonIndex index     pointer to the PersonIndexImp
+    I/O PersonEntry **ppLink  link from findPersonLink
+
+Returns:
+    N/A
+Notes:
+    The entry goes back on the free list; its slab is kept.
+**************************************************************************/
+void releasePersonEntry(PersonIndex index, PersonEntry **ppLink)
+{
+	PersonEntry *pEntry = *ppLink;
+	
+	if (pEntry->iArrivePending != 0 || pEntry->iDepartPending != 0
+		|| pEntry->iInside != 0)
+		return;
+	*ppLink = pEntry->pNextHash;
+	index->iEntryCnt--;
+	pEntry->pNextHash = index->pFreeEntry;
+	index->pFreeEntry = pEntry;
+}
+/******************** removePendingLink **********************************
+void removePendingLink(PersonIndex index, PersonEntry *pEntry, Event value)
+Purpose:
+    Unlinks the person's link for an event that left the queue (or
+    never got into it) and puts it back on the free list.
+Parameters:
+    I/O PersonIndex index     pointer to the PersonIndexImp
+    I/O PersonEntry *pEntry   the person's entry
+    I   Event value           the event
+
+Returns:
+    N/A
+Notes:
+    Links with the same time and type are interchangeable, so the first
+    match is taken; for a removed event it is normally the first link.
+**************************************************************************/
+void removePendingLink(PersonIndex index, PersonEntry *pEntry, Event value)
+{
+	PendingLink **ppLink = &pEntry->pPendingHead;
+	PendingLink *pLink;
+	
+	while (*ppLink != NULL && ((*ppLink)->iTime != value.iTime
+		|| (*ppLink)->iEventType != value.iEventType))
+		ppLink = &(*ppLink)->pNext;
+	if (*ppLink == NULL)
+		return;
+	pLink = *ppLink;
+	*ppLink = pLink->pNext;
+	pLink->pNext = index->pFreeLink;
+	index->pFreeLink = pLink;
+}
+// end person index functions
+// begin event queue functions
+/******************** newEventQueue **************************************
+EventQueue newEventQueue(int iBackend, long lBudgetBytes, int iMaxEvents
+    , int bPersonIndex)
+Purpose:
+    Dynamically allocates an empty event queue using the requested backend.
+Parameters:
+    I   int iBackend          EQ_LINKED_LIST or EQ_EXTERNAL
+    I   long lBudgetBytes     memory budget for EQ_EXTERNAL (ignored
+                              for EQ_LINKED_LIST)
+    I   int iMaxEvents        > 0 - reserve this many linked list nodes
+                                    and person index entries
+                              0   - allocate them as events arrive
+    I   int bPersonIndex      TRUE to keep a person index
+
+Returns:
+    A pointer to an EventQueueImp (with an empty person index if asked).
+    NULL if memory is unavailable.
+Notes:
+    N/A
+**************************************************************************/
+EventQueue newEventQueue(int iBackend, long lBudgetBytes, int iMaxEvents
+    , int bPersonIndex)
+{
+	EventQueue queue = (EventQueue) malloc(sizeof(EventQueueImp));
+	
+	if (queue == NULL)
+		return NULL;
+	queue->iBackend = iBackend;
+	queue->iMaxEvents = iMaxEvents;
+	queue->iPendingCnt = 0;
+	queue->list = NULL;
+	queue->extQueue = NULL;
+	queue->personIndex = NULL;
+	if (bPersonIndex)
+		queue->personIndex = newPersonIndex(iMaxEvents);
+	if (iBackend == EQ_EXTERNAL)
+		queue->extQueue = newExternalQueue(lBudgetBytes);
+	else
+	{
+		queue->list = newLinkedList();
+		if (queue->list != NULL && iMaxEvents > 0
+			&& !reserveNodesLL(queue->list, iMaxEvents))
+		{
+			freeLL(queue->list);
+			queue->list = NULL;
+		}
+	}
+	if ((bPersonIndex && queue->personIndex == NULL)
+		|| (queue->list == NULL && queue->extQueue == NULL))
+	{
+		freeEventQueue(queue);
+		return NULL;
+	}
+	return queue;
+}
+/******************** freeEventQueue *************************************
+void freeEventQueue(EventQueue queue)
+Purpose:
+    Frees the backend, the person index and the event queue.
+Parameters:
+    I   EventQueue queue      pointer to the EventQueueImp
+
+Returns:
+    N/A
+Notes:
+    Any events still pending are discarded.  Also used by newEventQueue
+    to free a partly built queue.
+**************************************************************************/
+void freeEventQueue(EventQueue queue)
+{
+	if (queue->extQueue != NULL)
+		freeExternalQueue(queue->extQueue);
+	if (queue->list != NULL)
+		freeLL(queue->list);
+	if (queue->personIndex != NULL)
+		freePersonIndex(queue->personIndex);
+	free(queue);
+}
+/******************** insertEventQ ***************************************
+int insertEventQ(EventQueue queue, Event value)
+Purpose:
+    Adds an event to the event queue.
+Parameters:
+    I   EventQueue queue      pointer to the EventQueueImp
+    I   Event value           event to be added
+
+Returns:
+    SIM_OK            - the event was added
+    SIM_ERR_FULL      - iMaxEvents events are already pending
+    SIM_ERR_NO_MEMORY - no node or person entry could be allocated
+    SIM_ERR_IO        - the external queue could not spill
+Notes:
+    Events with equal times are removed newest first, matching
+    insertOrderedLL, whichever backend is used.  The person index (if
+    any) records the event before the backend does, so a failure leaves
+    neither changed.  With iMaxEvents the reserved nodes and entries
+    cover every pending event, so only the first check can fail.
+**************************************************************************/
+int insertEventQ(EventQueue queue, Event value)
+{
+	int iNoRoom = (queue->iMaxEvents > 0) ? SIM_ERR_FULL : SIM_ERR_NO_MEMORY;
+	int iStatus;
+	
+	if (queue->iMaxEvents > 0 && queue->iPendingCnt >= queue->iMaxEvents)
+		return SIM_ERR_FULL;
+	if (queue->personIndex != NULL && !indexInsertEvent(queue->personIndex, value))
+		return iNoRoom;
+	if (queue->iBackend == EQ_EXTERNAL)
+		iStatus = insertExternal(queue->extQueue, value);
+	else
+		iStatus = (insertOrderedLL(queue->list, value) != NULL) ? SIM_OK : iNoRoom;
+	if (iStatus == SIM_OK)
+	{
+		queue->iPendingCnt++;
+		return SIM_OK;
+	}
+	
+	// backend refused the event; take it back out of the index
+	if (queue->personIndex != NULL)
+		indexUndoInsert(queue->personIndex, value);
+	return iStatus;
+}
+/******************** removeEventQ ***************************************
+int removeEventQ(EventQueue queue, Event *pValue)
+Purpose:
+    Removes the earliest event from the event queue.
+Parameters:
+    I   EventQueue queue      pointer to the EventQueueImp
+    O   Event *pValue         event removed
+
+Returns:
+    SIM_OK            - an event was removed
+    SIM_EMPTY         - the queue was empty
+    SIM_ERR_IO        - the external queue could not read a run
+Notes:
+    The person index drops the removed event.
+**************************************************************************/
+int removeEventQ(EventQueue queue, Event *pValue)
+{
+	int iStatus = takeEventQ(queue, pValue);
+	
+	if (iStatus == SIM_OK)
+		commitEventQ(queue, *pValue);
+	return iStatus;
+}
+/******************** takeEventQ *****************************************
+int takeEventQ(EventQueue queue, Event *pValue)
+Purpose:
+    Removes the earliest event from the backend only.
+Parameters:
+    I   EventQueue queue      pointer to the EventQueueImp
+    O   Event *pValue         event removed
+
+Returns:
+    SIM_OK            - an event was removed
+    SIM_EMPTY         - the queue was empty
+    SIM_ERR_IO        - the external queue could not read a run
+Notes:
+    The event still counts as pending, and the person index still holds
+    it, until commitEventQ; restoreEventQ puts it back instead.
+**************************************************************************/
+int takeEventQ(EventQueue queue, Event *pValue)
+{
+	if (queue->iBackend == EQ_EXTERNAL)
+		return removeExternal(queue->extQueue, pValue);
+	return removeLL(queue->list, pValue) ? SIM_OK : SIM_EMPTY;
+}
+/******************** commitEventQ ***************************************
+void commitEventQ(EventQueue queue, Event value)
+Purpose:
+    Finishes removing an event taken by takeEventQ.
+Parameters:
+    I   EventQueue queue      pointer to the EventQueueImp
+    I   Event value           event taken
+
+Returns:
+    N/A
+Notes:
+    The person index drops the event, so the person's presence changes
+    only now.
+**************************************************************************/
+void commitEventQ(EventQueue queue, Event value)
+{
+	queue->iPendingCnt--;
+	if (queue->personIndex != NULL)
+		indexRemoveEvent(queue->personIndex, value);
+}
+/******************** restoreEventQ **************************************
+int restoreEventQ(EventQueue queue, Event value)
+Purpose:
+    Puts an event taken by takeEventQ, and not committed, back in the
+    backend.
+Parameters:
+    I   EventQueue queue      pointer to the EventQueueImp
+    I   Event value           event taken
+
+Returns:
+    SIM_OK            - the event is back in the queue
+    SIM_ERR_NO_MEMORY - no node could be allocated (iMaxEvents is 0)
+    SIM_ERR_IO        - the external queue could not spill
+Notes:
+    The event goes before every other event at its time, like any new
+    one, so restoring taken events last to first returns them to the
+    front in their old order.  The person index and iPendingCnt still
+    hold the event, so neither changes, and with iMaxEvents the node it
+    left is still reserved for it.
+**************************************************************************/
+int restoreEventQ(EventQueue queue, Event value)
+{
+	if (queue->iBackend == EQ_EXTERNAL)
+		return insertExternal(queue->extQueue, value);
+	return (insertOrderedLL(queue->list, value) != NULL) ? SIM_OK : SIM_ERR_NO_MEMORY;
+}
+/******************** peekEventQ *****************************************
+int peekEventQ(EventQueue queue, Event *pValue)
+Purpose:
+    Returns the earliest event without removing it.
+Parameters:
+    I   EventQueue queue      pointer to the EventQueueImp
+    O   Event *pValue         event removeEventQ would return next
+
+Returns:
+    SIM_OK            - the queue was not empty
+    SIM_EMPTY         - the queue was empty
+    SIM_ERR_IO        - the external queue could not read a run
+Notes:
+    N/A
+**************************************************************************/
+int peekEventQ(EventQueue queue, Event *pValue)
+{
+	if (queue->iBackend == EQ_EXTERNAL)
+		return peekExternal(queue->extQueue, pValue);
+	if (queue->list->pHead == NULL)
+		return SIM_EMPTY;
+	*pValue = queue->list->pHead->event;
+	return SIM_OK;
+}
+/******************** removeBatchEventQ **********************************
+int removeBatchEventQ(EventQueue queue, Event eventM[], int iMaxEvents)
+Purpose:
+    Takes every event that shares the earliest time from the backend and
+    returns them in the order removeEventQ would have returned them.
+Parameters:
+    I   EventQueue queue      pointer to the EventQueueImp
+    O   Event eventM[]        events removed
+    I   int iMaxEvents        number of elements available in eventM
+
+Returns:
+    The number of events returned in eventM (0 if the queue was empty).
+    SIM_ERR_IO if the external queue could not read a run.
+Notes:
+    At most iMaxEvents are removed; any remaining events at the same time
+    stay at the front of the queue for the next call.  Each event must be
+    passed to commitEventQ when it runs, or to restoreEventQ.
+**************************************************************************/
+int removeBatchEventQ(EventQueue queue, Event eventM[], int iMaxEvents)
+{
+	Event nextEvent;
+	int iStatus;
+	int iCnt = 0;
+	
+	iStatus = takeEventQ(queue, &eventM[0]);
+	if (iStatus != SIM_OK)
+		return (iStatus == SIM_EMPTY) ? 0 : iStatus;
+	iCnt++;
+	while (iCnt < iMaxEvents
+		&& (iStatus = peekEventQ(queue, &nextEvent)) == SIM_OK
+		&& nextEvent.iTime == eventM[0].iTime)
+	{
+		if ((iStatus = takeEventQ(queue, &eventM[iCnt])) != SIM_OK)
+			break;
+		iCnt++;
+	}
+	if (iStatus < 0)
+		return iStatus;
+	return iCnt;
+}
+// end event queue functions
+// begin external-memory queue functions
+/******************** newExternalQueue ***********************************
+ExternalQueue newExternalQueue(long lBudgetBytes)
+Purpose:
+    Dynamically allocates an empty external-memory event queue.
+Parameters:
+    I   long lBudgetBytes     bytes the queue may hold in memory
+
+Returns:
+    A pointer to an ExternalQueueImp.
+    NULL if memory is unavailable.
+Notes:
+    Half of the budget is the in-memory heap; the other half is shared
+    by the read blocks of the EXT_MAX_RUNS run slots.  Everything is
+    allocated here, so inserts and removes only do file I/O.
+**************************************************************************/
+ExternalQueue newExternalQueue(long lBudgetBytes)
+{
+	ExternalQueue extQueue = (ExternalQueue) calloc(1, sizeof(ExternalQueueImp));
+	int i;
+	
+	if (extQueue == NULL)
+		return NULL;
+	extQueue->iHeapMax = (int) (lBudgetBytes / 2 / sizeof(ExtRecord));
+	if (extQueue->iHeapMax < 2)
+		extQueue->iHeapMax = 2;
+	extQueue->iBlockRecords = (int) (lBudgetBytes / 2 / EXT_MAX_RUNS
+		/ sizeof(ExtRecord));
+	if (extQueue->iBlockRecords < 1)
+		extQueue->iBlockRecords = 1;
+	extQueue->heapM = (ExtRecord *) malloc(extQueue->iHeapMax * sizeof(ExtRecord));
+	for (i = 0; i < EXT_MAX_RUNS; i++)
+	{
+		extQueue->runM[i].bufferM = (ExtRecord *) malloc(extQueue->iBlockRecords
+			* sizeof(ExtRecord));
+		if (extQueue->runM[i].bufferM == NULL)
+			extQueue->bIOError = TRUE;
+	}
+	if (extQueue->heapM == NULL || extQueue->bIOError)
+	{
+		freeExternalQueue(extQueue);
+		return NULL;
+	}
+	extQueue->iHeapCnt = 0;
+	extQueue->iRunCnt = 0;
+	extQueue->lNextSeq = 0;
+	return extQueue;
+}
+/******************** freeExternalQueue **********************************
+void freeExternalQueue(ExternalQueue extQueue)
+Purpose:
+    Closes (and thereby deletes) every run file and frees the queue.
+Parameters:
+    I   ExternalQueue extQueue  pointer to the ExternalQueueImp
+
+Returns:
+    N/A
+Notes:
+    N/A
+**************************************************************************/
+void freeExternalQueue(ExternalQueue extQueue)
+{
+	int i;
+	
+	for (i = 0; i < extQueue->iRunCnt; i++)
+		fclose(extQueue->runM[i].pFile);
+	for (i = 0; i < EXT_MAX_RUNS; i++)
+		free(extQueue->runM[i].bufferM);
+	free(extQueue->heapM);
+	free(extQueue);
+}
+/******************** compareExtRecord ***********************************
+int compareExtRecord(const void *pLeft, const void *pRight)
+Purpose:
+    qsort comparison giving the order events leave the queue.
+Parameters:
+    I   const void *pLeft     pointer to an ExtRecord
+    I   const void *pRight    pointer to an ExtRecord
+
+Returns:
+    < 0 - left comes first
+    0   - same record
+    > 0 - right comes first
+Notes:
+    Earlier times first; within a time, the higher (newer) sequence
+    number first, which is the order insertOrderedLL produces.
+**************************************************************************/
+int compareExtRecord(const void *pLeft, const void *pRight)
+{
+	const ExtRecord *pL = (const ExtRecord *) pLeft;
+	const ExtRecord *pR = (const ExtRecord *) pRight;
+	
+	if (pL->event.iTime != pR->event.iTime)
+		return (pL->event.iTime < pR->event.iTime) ? -1 : 1;
+	if (pL->lSeq != pR->lSeq)
+		return (pL->lSeq > pR->lSeq) ? -1 : 1;
+	return 0;
+}
+/******************** insertExternal *************************************
+int insertExternal(ExternalQueue extQueue, Event value)
+Purpose:
+    Adds an event to the in-memory heap, spilling the heap to a run
+    file first if it is full.
+Parameters:
+    I   ExternalQueue extQueue  pointer to the ExternalQueueImp
+    I   Event value             event to be added
+
+Returns:
+    SIM_OK            - the event was added
+    SIM_ERR_IO        - the heap was full and could not be spilled
+Notes:
+    O(log n) in the heap size plus an amortized share of the spill.
+**************************************************************************/
+int insertExternal(ExternalQueue extQueue, Event value)
+{
+	ExtRecord newRecord;
+	ExtRecord *heapM;
+	int iChild;
+	int iParent;
+	
+	if (extQueue->bIOError)
+		return SIM_ERR_IO;
+	if (extQueue->iHeapCnt == extQueue->iHeapMax
+		&& spillExternal(extQueue) != SIM_OK)
+		return SIM_ERR_IO;
+	newRecord.event = value;
+	newRecord.lSeq = extQueue->lNextSeq++;
+	
+	// sift the new record up from the bottom of the heap
+	heapM = extQueue->heapM;
+	iChild = extQueue->iHeapCnt++;
+	while (iChild > 0)
+	{
+		iParent = (iChild - 1) / 2;
+		if (compareExtRecord(&heapM[iParent], &newRecord) <= 0)
+			break;
+		heapM[iChild] = heapM[iParent];
+		iChild = iParent;
+	}
+	heapM[iChild] = newRecord;
+	return SIM_OK;
+}
+/******************** spillExternal **************************************
+int spillExternal(ExternalQueue extQueue)
+Purpose:
+    Sorts the in-memory heap and writes it to a new temporary run file
+    with a single fwrite, leaving the heap empty.
+Parameters:
+    I/O ExternalQueue extQueue  pointer to the ExternalQueueImp
+
+Returns:
+    SIM_OK            - the heap was spilled
+    SIM_ERR_IO        - a run file could not be created or written;
+                        bIOError is set and the queue is unusable
+Notes:
+    The new run is level 0.  Whenever a level then holds EXT_MERGE_FANIN
+    runs they are merged into one run of the next level (which may fill
+    that level in turn), using the emptied heap as the write buffer.  A
+    record is rewritten once per level, about log8(spills) times, and
+    no level keeps more than EXT_MERGE_FANIN - 1 runs, so runM never
+    overflows.
+**************************************************************************/
+int spillExternal(ExternalQueue extQueue)
+{
+	ExtRun *pRun = &extQueue->runM[extQueue->iRunCnt];
+	int iLevel;
+	int iLevelCnt;
+	int i;
+	
+	qsort(extQueue->heapM, extQueue->iHeapCnt, sizeof(ExtRecord), compareExtRecord);
+	pRun->pFile = tmpfile();
+	if (pRun->pFile == NULL)
+	{
+		extQueue->bIOError = TRUE;
+		return SIM_ERR_IO;
+	}
+	// the run owns its slot from here so freeExternalQueue closes it
+	extQueue->iRunCnt++;
+	if (fwrite(extQueue->heapM, sizeof(ExtRecord), extQueue->iHeapCnt, pRun->pFile)
+		!= (size_t) extQueue->iHeapCnt)
+	{
+		extQueue->bIOError = TRUE;
+		return SIM_ERR_IO;
+	}
+	rewind(pRun->pFile);
+	pRun->lRemaining = extQueue->iHeapCnt;
+	pRun->iBufferCnt = 0;
+	pRun->iBufferPos = 0;
+	pRun->iLevel = 0;
+	extQueue->iHeapCnt = 0;
+	
+	for (iLevel = 0; iLevel < EXT_MAX_LEVELS; iLevel++)
+	{
+		iLevelCnt = 0;
+		for (i = 0; i < extQueue->iRunCnt; i++)
+		{
+			if (extQueue->runM[i].iLevel == iLevel)
+				iLevelCnt++;
+		}
+		if (iLevelCnt < EXT_MERGE_FANIN)
+			break;
+		if (mergeExternalRuns(extQueue, iLevel) != SIM_OK)
+			return SIM_ERR_IO;
+	}
+	return SIM_OK;
+}
+/******************** mergeExternalRuns **********************************
+int mergeExternalRuns(ExternalQueue extQueue, int iLevel)
+Purpose:
+    Merges the runs of one level into a single new run of the next
+    level.
+Parameters:
+    I/O ExternalQueue extQueue  pointer to the ExternalQueueImp
+    I   int iLevel              level whose runs are merged
+
+Returns:
+    SIM_OK            - the runs were merged
+    SIM_ERR_IO        - a run file could not be used; bIOError is set
+Notes:
+    Only called right after a spill, when the heap is empty; heapM is
+    used as the output block so the merge stays within the budget.
+    The level's runs are first moved to the end of runM.  Runs of the
+    top level merge into a run of the top level.
+**************************************************************************/
+int mergeExternalRuns(ExternalQueue extQueue, int iLevel)
+{
+	FILE *pMergedFile;
+	long lMergedCnt = 0;
+	ExtRecord *pHead;
+	ExtRun swapRun;
+	ExtRun *pRun;
+	int iOutCnt = 0;
+	int iFirst = extQueue->iRunCnt;
+	int iMin;
+	int i;
+	
+	// runM[iFirst] through the last run are the ones to merge
+	for (i = extQueue->iRunCnt - 1; i >= 0; i--)
+	{
+		if (extQueue->runM[i].iLevel == iLevel)
+		{
+			swapRun = extQueue->runM[i];
+			extQueue->runM[i] = extQueue->runM[--iFirst];
+			extQueue->runM[iFirst] = swapRun;
+		}
+	}
+	
+	pMergedFile = tmpfile();
+	if (pMergedFile == NULL)
+	{
+		extQueue->bIOError = TRUE;
+		return SIM_ERR_IO;
+	}
+	
+	while ((iMin = findMinRun(extQueue, iFirst)) >= 0)
+	{
+		pHead = headOfRun(extQueue, &extQueue->runM[iMin]);
+		extQueue->heapM[iOutCnt++] = *pHead;
+		extQueue->runM[iMin].iBufferPos++;
+		if (iOutCnt == extQueue->iHeapMax)
+		{
+			if (fwrite(extQueue->heapM, sizeof(ExtRecord), iOutCnt, pMergedFile)
+				!= (size_t) iOutCnt)
+				break;
+			lMergedCnt += iOutCnt;
+			iOutCnt = 0;
+		}
+	}
+	if (iMin != EXT_MIN_NONE
+		|| fwrite(extQueue->heapM, sizeof(ExtRecord), iOutCnt, pMergedFile)
+			!= (size_t) iOutCnt)
+	{
+		fclose(pMergedFile);
+		extQueue->bIOError = TRUE;
+		return SIM_ERR_IO;
+	}
+	lMergedCnt += iOutCnt;
+	rewind(pMergedFile);
+	
+	// findMinRun closed the merged runs, so the slot after the rest is free
+	pRun = &extQueue->runM[extQueue->iRunCnt++];
+	pRun->pFile = pMergedFile;
+	pRun->lRemaining = lMergedCnt;
+	pRun->iBufferCnt = 0;
+	pRun->iBufferPos = 0;
+	pRun->iLevel = (iLevel + 1 < EXT_MAX_LEVELS) ? iLevel + 1 : iLevel;
+	return SIM_OK;
+}
+/******************** headOfRun ******************************************
+ExtRecord *headOfRun(ExternalQueue extQueue, ExtRun *pRun)
+Purpose:
+    Returns the next record of a run, reading the run's next block
+    when its buffer has been consumed.
+Parameters:
+    I   ExternalQueue extQueue  pointer to the ExternalQueueImp
+    I/O ExtRun *pRun            run to read
+
+Returns:
+    NULL    - the run is exhausted, or could not be read (bIOError set)
+    Address - the run's next record (in pRun->bufferM)
+Notes:
+    Each read is one fread of up to iBlockRecords records.
+**************************************************************************/
+ExtRecord *headOfRun(ExternalQueue extQueue, ExtRun *pRun)
+{
+	int iRead;
+	
+	if (pRun->iBufferPos < pRun->iBufferCnt)
+		return &pRun->bufferM[pRun->iBufferPos];
+	if (pRun->lRemaining == 0)
+		return NULL;
+	iRead = (pRun->lRemaining < extQueue->iBlockRecords)
+		? (int) pRun->lRemaining : extQueue->iBlockRecords;
+	if (fread(pRun->bufferM, sizeof(ExtRecord), iRead, pRun->pFile) != (size_t) iRead)
+	{
+		extQueue->bIOError = TRUE;
+		return NULL;
+	}
+	pRun->lRemaining -= iRead;
+	pRun->iBufferCnt = iRead;
+	pRun->iBufferPos = 0;
+	return &pRun->bufferM[0];
+}
+/******************** findMinExternal ************************************
+int findMinExternal(ExternalQueue extQueue)
+Purpose:
+    Finds where the earliest record in the queue is.
+Parameters:
+    I/O ExternalQueue extQueue  pointer to the ExternalQueueImp
+
+Returns:
+    EXT_MIN_HEAP  - the heap top is earliest
+    EXT_MIN_NONE  - the queue is empty
+    EXT_MIN_ERROR - a run could not be read
+    subscript     - runM subscript of the run whose head is earliest
+Notes:
+    See findMinRun for how exhausted runs are dropped.
+**************************************************************************/
+int findMinExternal(ExternalQueue extQueue)
+{
+	int iMin = findMinRun(extQueue, 0);
+	
+	if (iMin == EXT_MIN_ERROR)
+		return EXT_MIN_ERROR;
+	if (extQueue->iHeapCnt > 0 && (iMin == EXT_MIN_NONE
+		|| compareExtRecord(&extQueue->heapM[0]
+			, headOfRun(extQueue, &extQueue->runM[iMin])) < 0))
+		return EXT_MIN_HEAP;
+	return iMin;
+}
+/******************** findMinRun *****************************************
+int findMinRun(ExternalQueue extQueue, int iFirst)
+Purpose:
+    Finds the run whose head is earliest among runM[iFirst] through the
+    last run.
+Parameters:
+    I/O ExternalQueue extQueue  pointer to the ExternalQueueImp
+    I   int iFirst              subscript of the first run to consider
+
+Returns:
+    EXT_MIN_NONE  - every run considered is exhausted
+    EXT_MIN_ERROR - a run could not be read
+    subscript     - runM subscript of the run whose head is earliest
+Notes:
+    Exhausted runs are closed and removed from runM as they are found,
+    which may change the subscripts of later runs (never of runs before
+    iFirst).  A slot's read buffer moves with it so every slot keeps one.
+**************************************************************************/
+int findMinRun(ExternalQueue extQueue, int iFirst)
+{
+	ExtRecord *pMin = NULL;
+	ExtRecord *pHead;
+	ExtRecord *pSpareBuffer;
+	int iMin = EXT_MIN_NONE;
+	int i = iFirst;
+	
+	if (extQueue->bIOError)
+		return EXT_MIN_ERROR;
+	while (i < extQueue->iRunCnt)
+	{
+		pHead = headOfRun(extQueue, &extQueue->runM[i]);
+		if (extQueue->bIOError)
+			return EXT_MIN_ERROR;
+		if (pHead == NULL)
+		{
+			// run is exhausted; close it and fill its slot from the end
+			fclose(extQueue->runM[i].pFile);
+			pSpareBuffer = extQueue->runM[i].bufferM;
+			extQueue->runM[i] = extQueue->runM[--extQueue->iRunCnt];
+			extQueue->runM[extQueue->iRunCnt].bufferM = pSpareBuffer;
+			continue;
+		}
+		if (pMin == NULL || compareExtRecord(pHead, pMin) < 0)
+		{
+			pMin = pHead;
+			iMin = i;
+		}
+		i++;
+	}
+	return iMin;
+}
+/******************** peekExternal ***************************************
+int peekExternal(ExternalQueue extQueue, Event *pValue)
+Purpose:
+    Returns the earliest event without removing it.
+Parameters:
+    I   ExternalQueue extQueue  pointer to the ExternalQueueImp
+    O   Event *pValue           earliest event
+
+Returns:
+    SIM_OK            - the queue was not empty
+    SIM_EMPTY         - the queue was empty
+    SIM_ERR_IO        - a run could not be read
+Notes:
+    N/A
+**************************************************************************/
+int peekExternal(ExternalQueue extQueue, Event *pValue)
+{
+	int iMin = findMinExternal(extQueue);
+	
+	if (iMin == EXT_MIN_NONE)
+		return SIM_EMPTY;
+	if (iMin == EXT_MIN_ERROR)
+		return SIM_ERR_IO;
+	if (iMin == EXT_MIN_HEAP)
+		*pValue = extQueue->heapM[0].event;
+	else
+		*pValue = headOfRun(extQueue, &extQueue->runM[iMin])->event;
+	return SIM_OK;
+}
+/******************** removeExternal *************************************
+int removeExternal(ExternalQueue extQueue, Event *pValue)
+Purpose:
+    Removes the earliest event, taking it from the heap or from the
+    head of a run (a lazy k-way merge).
+Parameters:
+    I/O ExternalQueue extQueue  pointer to the ExternalQueueImp
+    O   Event *pValue           event removed
+
+Returns:
+    SIM_OK            - an event was removed
+    SIM_EMPTY         - the queue was empty
+    SIM_ERR_IO        - a run could not be read
+Notes:
+    O(log n) for the heap plus one comparison per run head; tiered
+    merging keeps that to EXT_MERGE_FANIN - 1 runs per level.
+**************************************************************************/
+int removeExternal(ExternalQueue extQueue, Event *pValue)
+{
+	ExtRecord *heapM = extQueue->heapM;
+	ExtRecord lastRecord;
+	ExtRun *pRun;
+	int iMin = findMinExternal(extQueue);
+	int iParent;
+	int iChild;
+	
+	if (iMin == EXT_MIN_NONE)
+		return SIM_EMPTY;
+	if (iMin == EXT_MIN_ERROR)
+		return SIM_ERR_IO;
+	if (iMin >= 0)
+	{
+		pRun = &extQueue->runM[iMin];
+		*pValue = pRun->bufferM[pRun->iBufferPos++].event;
+		return SIM_OK;
+	}
+	
+	// take the heap top and sift the last record down into its place
+	*pValue = heapM[0].event;
+	lastRecord = heapM[--extQueue->iHeapCnt];
+	iParent = 0;
+	while ((iChild = 2 * iParent + 1) < extQueue->iHeapCnt)
+	{
+		if (iChild + 1 < extQueue->iHeapCnt
+			&& compareExtRecord(&heapM[iChild + 1], &heapM[iChild]) < 0)
+			iChild++;
+		if (compareExtRecord(&lastRecord, &heapM[iChild]) <= 0)
+			break;
+		heapM[iParent] = heapM[iChild];
+		iParent = iChild;
+	}
+	heapM[iParent] = lastRecord;
+	return SIM_OK;
+}
+// end external-memory queue functions
+/************************** freeLL **************************************
+void freeLL(LinkedList list)
+Purpose:
+    Correctly frees an entire linked list ensuring no memory leaks.
+Parameters:
+    I  LinkedList list       pointer to a LinkedListImp
+
+Returns:
+    N/A
+Notes:
+    First, this function frees the NodeLL's which have been allocated 
+    memory (or the block of reserved nodes).  Next, the actual memory
+    allocated for the LinkedListImp structure is freed.
+**************************************************************************/
+void freeLL(LinkedList list)
+{
+	Event removeEvent;   // used to store returned 
+	                     // event from removeLL
+	// iterate node-by-node freeing each node; removeLL
+	// advances pHead so we never touch a freed node
+	while (removeLL(list, &removeEvent))
+		;
+	free(list->poolM);
+	// finally free the memory allocated for LinkedListImp structure
+	free(list);
+}
+// begin thread pool functions
+/************************** newThreadPool ************************************************
+ThreadPool newThreadPool(int iThreadCnt)
+Purpose:
+    Allocates a thread pool and starts its worker threads.
+Parameters:
+    I  int iThreadCnt            number of worker threads, 1 to MAX_THREADS
+Returns:
+    A pointer to a ThreadPoolImp structure
+    NULL if memory or a thread is unavailable
+Notes:
+    The workers sleep until runBatch posts a batch.
+*******************************************************************************************/
+ThreadPool newThreadPool(int iThreadCnt)
+{
+	ThreadPool pool = (ThreadPool) malloc(sizeof(ThreadPoolImp));
+	int i;
+	
+	if (pool == NULL)
+	    return NULL;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->workReady, NULL);
+	pthread_cond_init(&pool->workDone, NULL);
+	pool->eventM = NULL;
+	pool->handler = NULL;
+	pool->pContext = NULL;
+	pool->iBatchCnt = 0;
+	pool->iNextEvent = 0;
+	pool->iDoneCnt = 0;
+	pool->iGeneration = 0;
+	pool->bShutdown = FALSE;
+	pool->iThreadCnt = 0;
+	for (i = 0; i < iThreadCnt; i++)
+	{
+		if (pthread_create(&pool->threadM[i], NULL, workerThread, pool) != 0)
+		{
+			freeThreadPool(pool);       // stops the workers already started
+			return NULL;
+		}
+		pool->iThreadCnt++;
+	}
+	return pool;
+}
+/************************** freeThreadPool ***********************************************
+void freeThreadPool(ThreadPool pool)
+Purpose:
+    Stops the worker threads and frees the thread pool.
+Parameters:
+    I  ThreadPool pool           pointer to a ThreadPoolImp structure
+Returns:
+    N/A
+Notes:
+    Must not be called while runBatch is in progress.
+*******************************************************************************************/
+void freeThreadPool(ThreadPool pool)
+{
+	int i;
+	
+	pthread_mutex_lock(&pool->lock);
+	pool->bShutdown = TRUE;
+	pthread_cond_broadcast(&pool->workReady);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->iThreadCnt; i++)
+		pthread_join(pool->threadM[i], NULL);
+	pthread_cond_destroy(&pool->workDone);
+	pthread_cond_destroy(&pool->workReady);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+/************************** workerThread *************************************************
+void *workerThread(void *pArg)
+Purpose:
+    Body of each worker: waits for a batch, then claims events one at a
+    time and runs their handler until the batch is exhausted.
+Parameters:
+    I  void *pArg                the ThreadPool the worker belongs to
+Returns:
+    NULL when the pool is shut down
+Notes:
+    Handlers are given their own slot to write to, so the lock is held
+    just to claim an event and to count it finished.
+*******************************************************************************************/
+void *workerThread(void *pArg)
+{
+	ThreadPool pool = (ThreadPool) pArg;
+	int iSeenGeneration = 0;
+	int iEvent;
+	
+	pthread_mutex_lock(&pool->lock);
+	while (TRUE)
+	{
+		while (!pool->bShutdown && pool->iGeneration == iSeenGeneration)
+			pthread_cond_wait(&pool->workReady, &pool->lock);
+		if (pool->bShutdown)
+			break;
+		iSeenGeneration = pool->iGeneration;
+		while (pool->iNextEvent < pool->iBatchCnt)
+		{
+			iEvent = pool->iNextEvent++;
+			pthread_mutex_unlock(&pool->lock);
+			pool->handler(pool->eventM[iEvent], iEvent, pool->pContext);
+			pthread_mutex_lock(&pool->lock);
+			if (++pool->iDoneCnt == pool->iBatchCnt)
+				pthread_cond_signal(&pool->workDone);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+/************************** runBatch *****************************************************
+void runBatch(ThreadPool pool, EventHandler handler, void *pContext
+    , Event eventM[], int iBatchCnt)
+Purpose:
+    Runs the handler of every event in a same-time batch on the pool
+    and waits until all of them finish.
+Parameters:
+    I  ThreadPool pool           pointer to a ThreadPoolImp structure,
+                                 NULL to run the handlers on this thread
+    I  EventHandler handler      called with each event and its subscript
+    I  void *pContext            passed to handler
+    I  Event eventM[]            events of the batch
+    I  int iBatchCnt             number of events in eventM
+Returns:
+    N/A
+Notes:
+    Batches smaller than MIN_PARALLEL_BATCH are handled by the caller's
+    thread since waking the workers would cost more than the handler.
+*******************************************************************************************/
+void runBatch(ThreadPool pool, EventHandler handler, void *pContext
+    , Event eventM[], int iBatchCnt)
+{
+	int i;
+	
+	if (pool == NULL || iBatchCnt < MIN_PARALLEL_BATCH)
+	{
+		for (i = 0; i < iBatchCnt; i++)
+			handler(eventM[i], i, pContext);
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->eventM = eventM;
+	pool->handler = handler;
+	pool->pContext = pContext;
+	pool->iBatchCnt = iBatchCnt;
+	pool->iNextEvent = 0;
+	pool->iDoneCnt = 0;
+	pool->iGeneration++;
+	pthread_cond_broadcast(&pool->workReady);
+	while (pool->iDoneCnt < pool->iBatchCnt)
+		pthread_cond_wait(&pool->workDone, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+// end thread pool functions
+// begin simulation library functions
+/************************** simCreate ****************************************************
+Simulation simCreate(SimConfig *pConfig)
+Purpose:
+    Allocates a simulation with an empty event queue.
+Parameters:
+    I  SimConfig *pConfig        options, NULL for an unbounded in-memory
+                                 queue run on the caller's thread
+Returns:
+    A Simulation handle
+    NULL if memory, a thread or the configuration is unavailable
+Notes:
+    Every allocation the simulation will make with iMaxEvents > 0 is
+    made here, apart from the tmpfile() of each EQ_EXTERNAL run.
+*******************************************************************************************/
+Simulation simCreate(SimConfig *pConfig)
+{
+	SimConfig config = {EQ_LINKED_LIST, 0, 0, 1, IDX_DEFAULT};
+	Simulation sim;
+	int bPersonIndex;
+	
+	if (pConfig != NULL)
+		config = *pConfig;
+	if ((config.iBackend != EQ_LINKED_LIST && config.iBackend != EQ_EXTERNAL)
+		|| config.iMaxEvents < 0 || config.iThreadCnt > MAX_THREADS
+		|| config.iPersonIndex < IDX_DEFAULT || config.iPersonIndex > IDX_OFF)
+		return NULL;
+	if (config.iPersonIndex == IDX_DEFAULT)
+		bPersonIndex = (config.iBackend == EQ_LINKED_LIST);
+	else
+		bPersonIndex = (config.iPersonIndex == IDX_ON);
+	sim = (Simulation) malloc(sizeof(SimulationImp));
+	if (sim == NULL)
+		return NULL;
+	sim->iClock = 0;
+	sim->bRunning = FALSE;
+	sim->iBatchCnt = 0;
+	sim->iCommitCnt = 0;
+	sim->handler = NULL;
+	sim->callback = NULL;
+	sim->pContext = NULL;
+	sim->pool = NULL;
+	sim->pTraceLog = NULL;
+	sim->pTraceIndex = NULL;
+	sim->eventQueue = newEventQueue(config.iBackend, config.lBudgetBytes
+		, config.iMaxEvents, bPersonIndex);
+	if (config.iThreadCnt > 1)
+		sim->pool = newThreadPool(config.iThreadCnt);
+	if (sim->eventQueue == NULL || (config.iThreadCnt > 1 && sim->pool == NULL))
+	{
+		simDestroy(sim);
+		return NULL;
+	}
+	return sim;
+}
+/************************** simDestroy ***************************************************
+void simDestroy(Simulation sim)
+Purpose:
+    Stops the worker threads and frees the simulation and any events
+    still pending.
+Parameters:
+    I  Simulation sim            simulation handle
+Returns:
+    N/A
+Notes:
+    Must not be called from a handler or callback.
+*******************************************************************************************/
+void simDestroy(Simulation sim)
+{
+	if (sim->pool != NULL)
+		freeThreadPool(sim->pool);
+	if (sim->eventQueue != NULL)
+		freeEventQueue(sim->eventQueue);
+	free(sim);
+}
+/************************** simSchedule **************************************************
+int simSchedule(Simulation sim, Event event)
+Purpose:
+    Adds one event to the simulation.
+Parameters:
+    I  Simulation sim            simulation handle
+    I  Event event               event to schedule
+Returns:
+    SIM_OK            - the event was scheduled
+    SIM_ERR_BAD_EVENT - unknown event type, or iTime is before the clock
+    SIM_ERR_FULL      - iMaxEvents events are already pending
+    SIM_ERR_NO_MEMORY - no memory for the event (iMaxEvents is 0)
+    SIM_ERR_IO        - the external queue could not spill
+Notes:
+    May be called from a callback; the event may be at the current time.
+    It then runs next, as in the sequential loop, so the rest of the
+    batch is cut and put back behind it.
+*******************************************************************************************/
+int simSchedule(Simulation sim, Event event)
+{
+	int iStatus;
+	
+	if ((event.iEventType != EVT_ARRIVE && event.iEventType != EVT_DEPART)
+		|| event.iTime < sim->iClock)
+		return SIM_ERR_BAD_EVENT;
+	event.person.szName[MAX_NAME_SIZE] = '\0';
+	if (event.iTime == sim->iClock && sim->iBatchCnt > sim->iCommitCnt
+		&& (iStatus = cutBatch(sim)) != SIM_OK)
+		return iStatus;
+	return insertEventQ(sim->eventQueue, event);
+}
+/************************** simScheduleVisit *********************************************
+int simScheduleVisit(Simulation sim, char szName[], int iArriveTime, int iDepartUnits)
+Purpose:
+    Schedules a person's arrive event and the depart event iDepartUnits
+    later, the way addEventNodes does for each input line.
+Parameters:
+    I  Simulation sim            simulation handle
+    I  char szName[]             name of the person (truncated to
+                                 MAX_NAME_SIZE characters)
+    I  int iArriveTime           time the person arrives
+    I  int iDepartUnits          time units the person stays
+Returns:
+    SIM_OK or an error from simSchedule.  SIM_ERR_BAD_EVENT also covers
+    negative iDepartUnits.
+Notes:
+    With iMaxEvents, room for both events is checked first so a visit is
+    never half scheduled.
+*******************************************************************************************/
+int simScheduleVisit(Simulation sim, char szName[], int iArriveTime, int iDepartUnits)
+{
+	Event visitEvent;
+	int iStatus;
+	
+	if (iDepartUnits < 0 || iArriveTime < sim->iClock)
+		return SIM_ERR_BAD_EVENT;
+	if (sim->eventQueue->iMaxEvents > 0
+		&& sim->eventQueue->iPendingCnt + 2 > sim->eventQueue->iMaxEvents)
+		return SIM_ERR_FULL;
+	visitEvent.iEventType = EVT_ARRIVE;
+	visitEvent.iTime = iArriveTime;
+	strncpy(visitEvent.person.szName, szName, MAX_NAME_SIZE);
+	visitEvent.person.szName[MAX_NAME_SIZE] = '\0';
+	visitEvent.person.iDepartUnits = iDepartUnits;
+	if ((iStatus = simSchedule(sim, visitEvent)) != SIM_OK)
+		return iStatus;
+	
+	visitEvent.iEventType = EVT_DEPART;
+	visitEvent.iTime = iArriveTime + iDepartUnits;
+	return simSchedule(sim, visitEvent);
+}
+/************************** simSetCallbacks **********************************************
+void simSetCallbacks(Simulation sim, EventHandler handler, EventCallback callback
+    , void *pContext)
+Purpose:
+    Registers the functions run for each event.
+Parameters:
+    I  Simulation sim            simulation handle
+    I  EventHandler handler      run for every event of a same-time batch,
+                                 concurrently when there is a thread pool;
+                                 NULL for none
+    I  EventCallback callback    run for every event in event order on the
+                                 caller's thread; NULL for none
+    I  void *pContext            passed to both
+Returns:
+    N/A
+Notes:
+    The handler of every event in a batch finishes before the callback
+    of the first one starts.  A handler may run again for the same event
+    when a callback schedules an event at the current time (see
+    cutBatch).
+    The handler runs on worker threads with no lock held, so it must not
+    call any sim function; it should only work on its event and slot.
+    The callback may call simSchedule, simScheduleVisit and the query
+    functions.  simStep and simRunUntil from a callback return
+    SIM_ERR_BUSY, since the batch being committed would be overwritten,
+    and simDestroy, simSetCallbacks and simEnableTrace must not be called
+    from either.
+*******************************************************************************************/
+void simSetCallbacks(Simulation sim, EventHandler handler, EventCallback callback
+    , void *pContext)
+{
+	sim->handler = handler;
+	sim->callback = callback;
+	sim->pContext = pContext;
+}
+/************************** processEvents ************************************************
+int processEvents(Simulation sim, int iMaxEvents, int iUntilTime)
+Purpose:
+    Runs events one same-time batch at a time: removes the batch,
+    advances the clock, runs the handlers (on the pool if any) and then
+    the callbacks in removal order.
+Parameters:
+    I  Simulation sim            simulation handle
+    I  int iMaxEvents            stop after this many events
+    I  int iUntilTime            stop before the first event after this time
+Returns:
+    The number of events run, SIM_ERR_IO, or SIM_ERR_BUSY when called
+    from a callback.
+Notes:
+    Batches are cut short at iMaxEvents so simStep(sim, 1) runs exactly
+    one event, and by cutBatch when a callback schedules an event at the
+    current time, so the order never depends on how the run is driven.
+    Each event leaves the person index just before its callback, as it
+    would in the sequential loop.  The batch lives in the SimulationImp,
+    so no memory is allocated here; bRunning keeps a callback from
+    starting another run that would overwrite it.  When tracing, a snapshot is taken before a
+    batch that starts a new time once iSnapshotEvents, and at least as
+    many events as there are occupants, have been traced.  The batch is
+    appended to the log after its callbacks.
+*******************************************************************************************/
+int processEvents(Simulation sim, int iMaxEvents, int iUntilTime)
+{
+	Event nextEvent;
+	int iDone = 0;
+	int iBatchCnt;
+	int iStatus = SIM_OK;
+	int i;
+	
+	if (sim->bRunning)
+		return SIM_ERR_BUSY;
+	sim->bRunning = TRUE;
+	while (iDone < iMaxEvents)
+	{
+		iStatus = peekEventQ(sim->eventQueue, &nextEvent);
+		if (iStatus == SIM_EMPTY || (iStatus == SIM_OK && nextEvent.iTime > iUntilTime))
+			break;
+		if (iStatus != SIM_OK)
+			break;
+		// snapshot while the person index excludes this time's events
+		if (sim->pTraceLog != NULL && sim->iSinceSnapshot >= sim->iSnapshotEvents
+			&& sim->iSinceSnapshot >= getOccupantCount(sim->eventQueue->personIndex)
+			&& nextEvent.iTime > sim->iLastTraceTime
+			&& (iStatus = writeTraceSnapshot(sim, nextEvent.iTime)) != SIM_OK)
+			break;
+		
+		iBatchCnt = iMaxEvents - iDone;
+		if (iBatchCnt > MAX_BATCH_EVENTS)
+			iBatchCnt = MAX_BATCH_EVENTS;
+		iBatchCnt = removeBatchEventQ(sim->eventQueue, sim->batchM, iBatchCnt);
+		if (iBatchCnt < 0)
+		{
+			iStatus = iBatchCnt;
+			break;
+		}
+		
+		sim->iClock = sim->batchM[0].iTime;
+		sim->iBatchCnt = iBatchCnt;
+		if (sim->handler != NULL)
+			runBatch(sim->pool, sim->handler, sim->pContext, sim->batchM, iBatchCnt);
+		// commit in removal order; a callback may shrink iBatchCnt
+		while (sim->iCommitCnt < sim->iBatchCnt)
+		{
+			i = sim->iCommitCnt++;
+			commitEventQ(sim->eventQueue, sim->batchM[i]);
+			if (sim->callback != NULL)
+				sim->callback(sim->batchM[i], i, sim->pContext);
+		}
+		iBatchCnt = sim->iBatchCnt;
+		sim->iBatchCnt = 0;
+		sim->iCommitCnt = 0;
+		if (sim->pTraceLog != NULL
+			&& (iStatus = writeTraceEvents(sim, sim->batchM, iBatchCnt)) != SIM_OK)
+			break;
+		iDone += iBatchCnt;
+	}
+	sim->bRunning = FALSE;
+	return (iStatus < 0) ? iStatus : iDone;
+}
+/************************** cutBatch *****************************************************
+int cutBatch(Simulation sim)
+Purpose:
+    Puts the events of the current batch whose callbacks have not
+    started back at the front of the queue.
+Parameters:
+    I  Simulation sim            simulation handle
+Returns:
+    SIM_OK            - the batch now ends at the callback running
+    SIM_ERR_NO_MEMORY - no node for an event (iMaxEvents is 0)
+    SIM_ERR_IO        - the external queue could not spill
+Notes:
+    Called by simSchedule before it adds an event at the current time
+    from a callback.  The sequential loop would run that event next, and
+    once it is queued ahead of the put-back events it will be.  Events
+    are put back last to first, so on an error the ones not yet put back
+    are still the end of the batch and the order is kept.
+*******************************************************************************************/
+int cutBatch(Simulation sim)
+{
+	int iStatus;
+	
+	while (sim->iBatchCnt > sim->iCommitCnt)
+	{
+		iStatus = restoreEventQ(sim->eventQueue, sim->batchM[sim->iBatchCnt - 1]);
+		if (iStatus != SIM_OK)
+			return iStatus;
+		sim->iBatchCnt--;
+	}
+	return SIM_OK;
+}
+/************************** simStep ******************************************************
+int simStep(Simulation sim, int iSteps)
+Purpose:
+    Runs the next iSteps events (fewer if the queue empties).
+Parameters:
+    I  Simulation sim            simulation handle
+    I  int iSteps                number of events to run
+Returns:
+    The number of events run, SIM_ERR_IO, or SIM_ERR_BUSY from a callback.
+Notes:
+    N/A
+*******************************************************************************************/
+int simStep(Simulation sim, int iSteps)
+{
+	return processEvents(sim, iSteps, INT_MAX);
+}
+/************************** simRunUntil **************************************************
+int simRunUntil(Simulation sim, int iTime)
+Purpose:
+    Runs every event at or before iTime.
+Parameters:
+    I  Simulation sim            simulation handle
+    I  int iTime                 last time to run
+Returns:
+    The number of events run, SIM_ERR_IO, or SIM_ERR_BUSY from a callback.
+Notes:
+    The clock is left at the time of the last event run, not at iTime.
+*******************************************************************************************/
+int simRunUntil(Simulation sim, int iTime)
+{
+	return processEvents(sim, INT_MAX, iTime);
+}
+/************************** simPeekNextTime **********************************************
+int simPeekNextTime(Simulation sim, int *piTime)
+Purpose:
+    Returns the time of the next pending event.
+Parameters:
+    I  Simulation sim            simulation handle
+    O  int *piTime               time of the next event
+Returns:
+    SIM_OK, SIM_EMPTY (no pending events) or SIM_ERR_IO.
+Notes:
+    From a callback, the rest of the batch is still pending.
+*******************************************************************************************/
+int simPeekNextTime(Simulation sim, int *piTime)
+{
+	Event nextEvent;
+	int iStatus;
+	
+	if (sim->iBatchCnt > sim->iCommitCnt)
+	{
+		*piTime = sim->iClock;
+		return SIM_OK;
+	}
+	iStatus = peekEventQ(sim->eventQueue, &nextEvent);
+	if (iStatus == SIM_OK)
+		*piTime = nextEvent.iTime;
+	return iStatus;
+}
+/************************** simGetClock **************************************************
+int simGetClock(Simulation sim)
+Purpose:
+    Returns the simulation clock: the time of the last event run.
+Parameters:
+    I  Simulation sim            simulation handle
+Returns:
+    The clock time (0 before any event has run).
+Notes:
+    N/A
+*******************************************************************************************/
+int simGetClock(Simulation sim)
+{
+	return sim->iClock;
+}
+/************************** simGetOccupantCount ******************************************
+int simGetOccupantCount(Simulation sim)
+Purpose:
+    Returns the number of people who have arrived and not yet departed.
+Parameters:
+    I  Simulation sim            simulation handle
+Returns:
+    The occupant count, or SIM_ERR_NO_INDEX.
+Notes:
+    O(1) from the person index.
+*******************************************************************************************/
+int simGetOccupantCount(Simulation sim)
+{
+	if (sim->eventQueue->personIndex == NULL)
+		return SIM_ERR_NO_INDEX;
+	return getOccupantCount(sim->eventQueue->personIndex);
+}
+/************************** simGetOccupants **********************************************
+int simGetOccupants(Simulation sim, char szNameM[][MAX_NAME_SIZE + 1], int iMaxNames)
+Purpose:
+    Lists the people who have arrived and not yet departed.
+Parameters:
+    I  Simulation sim            simulation handle
+    O  char szNameM[][]          names of the occupants
+    I  int iMaxNames             number of names szNameM can hold
+Returns:
+    The number of names returned, or SIM_ERR_NO_INDEX.
+Notes:
+    O(k) in the number of occupants; most recent arrival first.
+*******************************************************************************************/
+int simGetOccupants(Simulation sim, char szNameM[][MAX_NAME_SIZE + 1], int iMaxNames)
+{
+	PersonEntry *pEntry;
+	int iCnt = 0;
+	
+	if (sim->eventQueue->personIndex == NULL)
+		return SIM_ERR_NO_INDEX;
+	for (pEntry = sim->eventQueue->personIndex->pOccupantHead
+		; pEntry != NULL && iCnt < iMaxNames
+		; pEntry = pEntry->pNextOccupant)
+	{
+		strcpy(szNameM[iCnt++], pEntry->szName);
+	}
+	return iCnt;
+}
+/************************** simFindPerson ************************************************
+int simFindPerson(Simulation sim, char szName[], int *pbPresent, int *piDepartTime)
+Purpose:
+    Answers "is this person here, and when do they leave?"
+Parameters:
+    I  Simulation sim            simulation handle
+    I  char szName[]             name of the person
+    O  int *pbPresent            TRUE if the person has arrived and not
+                                 yet departed
+    O  int *piDepartTime         time the person's current stay ends, or
+                                 their next stay if they are not present;
+                                 -1 if no pending depart ends it
+Returns:
+    SIM_OK           - the person is present or has events pending
+    SIM_EMPTY        - the simulation knows nothing about the person
+    SIM_ERR_NO_INDEX - the simulation has no person index
+Notes:
+    Overlapping visits keep a person present until the last of them
+    ends, so the pending events are replayed in queue order with the
+    same counting indexRemoveEvent does, and the depart that brings
+    iInside to 0 is the answer.  Expected O(1) from the person index
+    plus the person's own pending events.
+*******************************************************************************************/
+int simFindPerson(Simulation sim, char szName[], int *pbPresent, int *piDepartTime)
+{
+	PersonEntry *pEntry;
+	PendingLink *pLink;
+	int iInside;
+	int iDepartPending;
+	
+	if (sim->eventQueue->personIndex == NULL)
+		return SIM_ERR_NO_INDEX;
+	pEntry = lookupPerson(sim->eventQueue->personIndex, szName);
+	if (pEntry == NULL)
+		return SIM_EMPTY;
+	*pbPresent = (pEntry->iInside > 0);
+	*piDepartTime = -1;
+	iInside = pEntry->iInside;
+	iDepartPending = pEntry->iDepartPending;
+	for (pLink = pEntry->pPendingHead; pLink != NULL; pLink = pLink->pNext)
+	{
+		if (pLink->iEventType == EVT_ARRIVE)
+		{
+			if (iDepartPending > 0)
+				iInside++;
+			continue;
+		}
+		iDepartPending--;
+		if (iInside > 0 && --iInside == 0)
+		{
+			*piDepartTime = pLink->iTime;
+			break;
+		}
+	}
+	return SIM_OK;
+}
+// end simulation library functions
+// begin trace functions
+/************************** simEnableTrace ***********************************************
+int simEnableTrace(Simulation sim, FILE *pLogFile, FILE *pIndexFile, int iSnapshotEvents)
+Purpose:
+    Starts tracing every event run to pLogFile, with a snapshot of the
+    people present indexed in pIndexFile about every iSnapshotEvents
+    events.  With more people present than that, snapshots are spaced
+    by the occupant count instead, so they never take more of the log
+    than the events do.
+Parameters:
+    I  Simulation sim            simulation handle
+    I  FILE *pLogFile            empty binary file opened for writing
+    I  FILE *pIndexFile          empty binary file opened for writing
+    I  int iSnapshotEvents       least events between snapshots (at
+                                 least 1); a query replays about
+                                 max(iSnapshotEvents, occupants) events
+Returns:
+    SIM_OK, SIM_ERR_BAD_EVENT (iSnapshotEvents < 1), SIM_ERR_NO_INDEX
+    (snapshots come from the person index) or SIM_ERR_IO.
+Notes:
+    A first snapshot of the current occupants is written at the clock
+    time, so the trace answers queries from there on.  The files stay
+    owned by the host, which closes (or flushes) them before querying.
+*******************************************************************************************/
+int simEnableTrace(Simulation sim, FILE *pLogFile, FILE *pIndexFile, int iSnapshotEvents)
+{
+	if (iSnapshotEvents < 1)
+		return SIM_ERR_BAD_EVENT;
+	if (sim->eventQueue->personIndex == NULL)
+		return SIM_ERR_NO_INDEX;
+	sim->pTraceLog = pLogFile;
+	sim->pTraceIndex = pIndexFile;
+	sim->iSnapshotEvents = iSnapshotEvents;
+	sim->iLastTraceTime = sim->iClock;
+	return writeTraceSnapshot(sim, sim->iClock);
+}
+/************************** writeTraceSnapshot *******************************************
+int writeTraceSnapshot(Simulation sim, int iTime)
+Purpose:
+    Appends the people now present to the log as a TRACE_PRESENT block
+    and indexes the block under iTime.
+Parameters:
+    I  Simulation sim            simulation handle
+    I  int iTime                 time of the next event to be traced
+Returns:
+    SIM_OK or SIM_ERR_IO.
+Notes:
+    Only called between times, so the block holds every event before
+    iTime and none at or after it.
+*******************************************************************************************/
+int writeTraceSnapshot(Simulation sim, int iTime)
+{
+	TraceIndexEntry entry;
+	TraceRecord record;
+	PersonEntry *pEntry;
+	
+	entry.iTime = iTime;
+	entry.iPresentCnt = 0;
+	entry.lSnapshotOffset = ftell(sim->pTraceLog);
+	if (entry.lSnapshotOffset < 0)
+		return SIM_ERR_IO;
+	
+	memset(&record, 0, sizeof(record));
+	record.iRecordType = TRACE_PRESENT;
+	record.bPresent = TRUE;
+	record.event.iTime = iTime;
+	for (pEntry = sim->eventQueue->personIndex->pOccupantHead
+		; pEntry != NULL
+		; pEntry = pEntry->pNextOccupant)
+	{
+		strcpy(record.event.person.szName, pEntry->szName);
+		if (fwrite(&record, sizeof(record), 1, sim->pTraceLog) != 1)
+			return SIM_ERR_IO;
+		entry.iPresentCnt++;
+	}
+	if (fwrite(&entry, sizeof(entry), 1, sim->pTraceIndex) != 1)
+		return SIM_ERR_IO;
+	sim->iSinceSnapshot = 0;
+	return SIM_OK;
+}
+/************************** writeTraceEvents *********************************************
+int writeTraceEvents(Simulation sim, Event eventM[], int iEventCnt)
+Purpose:
+    Appends a batch of events that were just run to the log.
+Parameters:
+    I  Simulation sim            simulation handle
+    I  Event eventM[]            the batch, in removal order
+    I  int iEventCnt             number of events in the batch
+Returns:
+    SIM_OK or SIM_ERR_IO.
+Notes:
+    Each record carries the person's presence from the person index
+    after the batch, so a replay needs no rules of its own.  Later
+    records for the same person and time override earlier ones.
+*******************************************************************************************/
+int writeTraceEvents(Simulation sim, Event eventM[], int iEventCnt)
+{
+	TraceRecord record;
+	PersonEntry *pEntry;
+	int i;
+	
+	record.iRecordType = TRACE_EVENT;
+	for (i = 0; i < iEventCnt; i++)
+	{
+		record.event = eventM[i];
+		pEntry = lookupPerson(sim->eventQueue->personIndex, eventM[i].person.szName);
+		record.bPresent = (pEntry != NULL && pEntry->iInside > 0);
+		if (fwrite(&record, sizeof(record), 1, sim->pTraceLog) != 1)
+			return SIM_ERR_IO;
+	}
+	sim->iSinceSnapshot += iEventCnt;
+	sim->iLastTraceTime = eventM[iEventCnt - 1].iTime;
+	return SIM_OK;
+}
+/************************** simQueryTrace ************************************************
+int simQueryTrace(FILE *pLogFile, FILE *pIndexFile, int iTime
+    , char szNameM[][MAX_NAME_SIZE + 1], int iMaxNames, int *piPresentCnt)
+Purpose:
+    Lists the people present in a traced run once every event at or
+    before iTime had run.
+Parameters:
+    I  FILE *pLogFile            trace log opened for binary reading
+    I  FILE *pIndexFile          trace index opened for binary reading
+    I  int iTime                 time of interest
+    O  char szNameM[][]          names of the people present
+    I  int iMaxNames             number of names szNameM can hold
+    O  int *piPresentCnt         number of names returned
+Returns:
+    SIM_OK
+    SIM_EMPTY         - iTime is before the trace started
+    SIM_ERR_FULL      - more than iMaxNames people were present
+    SIM_ERR_NO_MEMORY - no memory for the name hash
+    SIM_ERR_IO        - a file could not be read
+Notes:
+    Binary searches the index for the last snapshot at or before iTime,
+    loads it and replays only the events after it.  The snapshot's names
+    are unique and are appended as read; tail events find their name
+    through a hash of iMaxNames subscripts, allocated for the query.
+    The cost is log2 index seeks plus O(occupants + iSnapshotEvents),
+    however long the trace is.
+*******************************************************************************************/
+int simQueryTrace(FILE *pLogFile, FILE *pIndexFile, int iTime
+    , char szNameM[][MAX_NAME_SIZE + 1], int iMaxNames, int *piPresentCnt)
+{
+	TraceIndexEntry entry;
+	TraceRecord record;
+	TraceNameSet set;
+	int iStatus;
+	int i;
+	
+	*piPresentCnt = 0;
+	if ((iStatus = findTraceSnapshot(pIndexFile, iTime, &entry)) != SIM_OK)
+		return iStatus;
+	if (entry.iPresentCnt > iMaxNames)
+		return SIM_ERR_FULL;
+	if (fseek(pLogFile, entry.lSnapshotOffset, SEEK_SET) != 0)
+		return SIM_ERR_IO;
+	
+	set.szNameM = szNameM;
+	set.iMaxNames = iMaxNames;
+	set.iNameCnt = 0;
+	set.iBucketCnt = 16;
+	while (set.iBucketCnt < iMaxNames)
+		set.iBucketCnt *= 2;
+	set.bucketM = (int *) malloc((set.iBucketCnt + iMaxNames) * sizeof(int));
+	if (set.bucketM == NULL)
+		return SIM_ERR_NO_MEMORY;
+	set.nextM = set.bucketM + set.iBucketCnt;
+	for (i = 0; i < set.iBucketCnt; i++)
+		set.bucketM[i] = -1;
+	
+	// the snapshot block, then the tail up to the first event after iTime
+	for (i = 0; i < entry.iPresentCnt && iStatus == SIM_OK; i++)
+	{
+		if (fread(&record, sizeof(record), 1, pLogFile) != 1)
+			iStatus = SIM_ERR_IO;
+		else
+			iStatus = addTraceName(&set, record.event.person.szName);
+	}
+	while (iStatus == SIM_OK && fread(&record, sizeof(record), 1, pLogFile) == 1
+		&& record.event.iTime <= iTime)
+		iStatus = applyTraceRecord(&record, &set);
+	if (iStatus == SIM_OK && ferror(pLogFile))
+		iStatus = SIM_ERR_IO;
+	
+	free(set.bucketM);
+	*piPresentCnt = set.iNameCnt;
+	return iStatus;
+}
+/************************** findTraceSnapshot ********************************************
+int findTraceSnapshot(FILE *pIndexFile, int iTime, TraceIndexEntry *pEntry)
+Purpose:
+    Finds the last index entry whose time is at or before iTime.
+Parameters:
+    I  FILE *pIndexFile          trace index opened for binary reading
+    I  int iTime                 time of interest
+    O  TraceIndexEntry *pEntry   the entry found
+Returns:
+    SIM_OK, SIM_EMPTY (every entry is after iTime) or SIM_ERR_IO.
+Notes:
+    Entries are fixed size and in increasing time, so this is a binary
+    search by fseek that reads O(log n) entries.
+*******************************************************************************************/
+int findTraceSnapshot(FILE *pIndexFile, int iTime, TraceIndexEntry *pEntry)
+{
+	TraceIndexEntry probe;
+	long lLow = 0;
+	long lHigh;
+	long lMid;
+	int bFound = FALSE;
+	
+	if (fseek(pIndexFile, 0L, SEEK_END) != 0 || (lHigh = ftell(pIndexFile)) < 0)
+		return SIM_ERR_IO;
+	lHigh = lHigh / (long) sizeof(TraceIndexEntry) - 1;
+	while (lLow <= lHigh)
+	{
+		lMid = lLow + (lHigh - lLow) / 2;
+		if (fseek(pIndexFile, lMid * (long) sizeof(TraceIndexEntry), SEEK_SET) != 0
+			|| fread(&probe, sizeof(probe), 1, pIndexFile) != 1)
+			return SIM_ERR_IO;
+		if (probe.iTime <= iTime)
+		{
+			*pEntry = probe;
+			bFound = TRUE;
+			lLow = lMid + 1;
+		}
+		else
+			lHigh = lMid - 1;
+	}
+	return bFound ? SIM_OK : SIM_EMPTY;
+}
+/************************** applyTraceRecord *********************************************
+int applyTraceRecord(TraceRecord *pRecord, TraceNameSet *pSet)
+Purpose:
+    Adds or removes the record's person from the set being replayed.
+Parameters:
+    I   TraceRecord *pRecord     event record of the tail
+    I/O TraceNameSet *pSet       people present
+Returns:
+    SIM_OK or SIM_ERR_FULL.
+Notes:
+    Expected O(1).
+*******************************************************************************************/
+int applyTraceRecord(TraceRecord *pRecord, TraceNameSet *pSet)
+{
+	int *pLink = findTraceLink(pSet, pRecord->event.person.szName);
+	
+	if (pRecord->bPresent && *pLink < 0)
+		return addTraceName(pSet, pRecord->event.person.szName);
+	if (!pRecord->bPresent && *pLink >= 0)
+		removeTraceName(pSet, pLink);
+	return SIM_OK;
+}
+/************************** addTraceName *************************************************
+int addTraceName(TraceNameSet *pSet, char szName[])
+Purpose:
+    Appends a name that is not in the set yet.
+Parameters:
+    I/O TraceNameSet *pSet       people present
+    I   char szName[]            name to add
+Returns:
+    SIM_OK or SIM_ERR_FULL.
+Notes:
+    The caller makes sure the name is not already there.
+*******************************************************************************************/
+int addTraceName(TraceNameSet *pSet, char szName[])
+{
+	unsigned int uiBucket = hashPersonName(szName) & (pSet->iBucketCnt - 1);
+	int iNew = pSet->iNameCnt;
+	
+	if (iNew >= pSet->iMaxNames)
+		return SIM_ERR_FULL;
+	strncpy(pSet->szNameM[iNew], szName, MAX_NAME_SIZE);
+	pSet->szNameM[iNew][MAX_NAME_SIZE] = '\0';
+	pSet->nextM[iNew] = pSet->bucketM[uiBucket];
+	pSet->bucketM[uiBucket] = iNew;
+	pSet->iNameCnt++;
+	return SIM_OK;
+}
+/************************** findTraceLink ************************************************
+int *findTraceLink(TraceNameSet *pSet, char szName[])
+Purpose:
+    Finds the link (bucket head or nextM element) that holds a name's
+    subscript.
+Parameters:
+    I   TraceNameSet *pSet       people present
+    I   char szName[]            name to find
+Returns:
+    Address of the link; the link is -1 if the name is not in the set.
+Notes:
+    N/A
+*******************************************************************************************/
+int *findTraceLink(TraceNameSet *pSet, char szName[])
+{
+	unsigned int uiBucket = hashPersonName(szName) & (pSet->iBucketCnt - 1);
+	int *pLink;
+	
+	for (pLink = &pSet->bucketM[uiBucket]; *pLink >= 0; pLink = &pSet->nextM[*pLink])
+	{
+		if (strncmp(pSet->szNameM[*pLink], szName, MAX_NAME_SIZE) == 0)
+			break;
+	}
+	return pLink;
+}
+/************************** removeTraceName **********************************************
+void removeTraceName(TraceNameSet *pSet, int *pLink)
+Purpose:
+    Removes a name from the set.
+Parameters:
+    I/O TraceNameSet *pSet       people present
+    I/O int *pLink               link from findTraceLink
+Returns:
+    N/A
+Notes:
+    The last name moves into the freed subscript and its link is
+    repointed, so szNameM stays packed.
+*******************************************************************************************/
+void removeTraceName(TraceNameSet *pSet, int *pLink)
+{
+	int iGone = *pLink;
+	int iLast = pSet->iNameCnt - 1;
+	int *pLastLink;
+	
+	*pLink = pSet->nextM[iGone];
+	pSet->iNameCnt--;
+	if (iGone == iLast)
+		return;
+	pLastLink = findTraceLink(pSet, pSet->szNameM[iLast]);
+	*pLastLink = iGone;
+	pSet->nextM[iGone] = pSet->nextM[iLast];
+	memcpy(pSet->szNameM[iGone], pSet->szNameM[iLast], MAX_NAME_SIZE + 1);
+}
+// end trace functions
@@ -0,0 +1,133 @@
+/**********************************************************************
+cs2123p3sim.h
+Purpose:
+    Public interface of the event simulation library.  A host program
+    includes only this header and links cs2123p3sim.c.
+    Defines constants:
+        event type constants
+        event queue backend constants
+        person index constants
+        status constants (returned by the sim functions)
+    Defines typedef for
+        Person
+        Event
+        Simulation (opaque handle)
+        SimConfig
+        EventHandler
+        EventCallback
+    Protypes
+        Simulation library functions
+        Trace functions
+Notes:
+    No library function prints or exits; failures are returned as
+    SIM_ERR_* status values.  When SimConfig.iMaxEvents is given, all
+    memory is allocated by simCreate and no later call allocates, except
+    that EQ_EXTERNAL opens a tmpfile() (which stdio may allocate) for
+    each run it spills or merges while scheduling.
+**********************************************************************/
+#ifndef CS2123P3SIM_H
+#define CS2123P3SIM_H
+
+#include <stdio.h>
+
+/*** constants ***/
+#define MAX_NAME_SIZE 11        // Maximum number of actual characters for a name
+#define MAX_BATCH_EVENTS 256    // Maximum events handled together for one time
+#define MAX_THREADS 16          // Maximum number of worker threads
+
+// Event Constants
+#define EVT_ARRIVE          1      // when a person arrives
+#define EVT_DEPART          2      // when a person departs the simulation
+
+// Event queue backends
+#define EQ_LINKED_LIST      1      // ordered linked list held in memory
+#define EQ_EXTERNAL         2      // bounded heap that spills sorted runs to disk
+
+// Person index choices (SimConfig.iPersonIndex)
+#define IDX_DEFAULT         0      // on for EQ_LINKED_LIST, off for EQ_EXTERNAL
+#define IDX_ON              1      // keep the person index
+#define IDX_OFF             2      // no occupancy queries or trace
+
+// Status constants (sim function return values)
+#define SIM_OK              0      // call succeeded
+#define SIM_EMPTY           1      // no pending event / person not found
+#define SIM_ERR_FULL        -1     // event or person capacity exhausted
+#define SIM_ERR_BAD_EVENT   -2     // unknown event type or event in the past
+#define SIM_ERR_NO_MEMORY   -3     // memory could not be allocated
+#define SIM_ERR_IO          -4     // external queue run file or trace failed
+#define SIM_ERR_NO_INDEX    -5     // query needs the person index, which is off
+#define SIM_ERR_BUSY        -6     // simStep/simRunUntil called from a callback
+
+/*** typedef ***/
+typedef struct
+{
+    char szName[MAX_NAME_SIZE + 1];  // Name
+    int iDepartUnits;      // time units representing how long he stays around
+} Person;
+
+typedef struct
+{
+    int iEventType;         // The type of event as an integer:
+                            //    EVT_ARRIVE - arrival event
+                            //    EVT_DEPART - departure event
+    int iTime;              // The time the event will occur
+    Person person;          // The person invokved in the event.
+} Event;
+
+// Opaque handle; the structure is private to the library
+typedef struct SimulationImp *Simulation;
+
+// Options for simCreate
+typedef struct
+{
+    int iBackend;           // EQ_LINKED_LIST or EQ_EXTERNAL
+    long lBudgetBytes;      // memory budget for EQ_EXTERNAL
+    int iMaxEvents;         // > 0 - preallocate this many pending events
+                            //       and people; scheduling fails with
+                            //       SIM_ERR_FULL beyond it
+                            // 0   - allocate as events are scheduled
+    int iThreadCnt;         // > 1 runs the EventHandler of events sharing
+                            //     a time on this many worker threads
+    int iPersonIndex;       // IDX_DEFAULT, IDX_ON or IDX_OFF.  The index
+                            // answers the occupancy queries and the trace
+                            // but holds about 56 bytes per person and 16
+                            // per pending event in memory, outside the
+                            // EQ_EXTERNAL budget, so that backend leaves it
+                            // off unless asked.
+} SimConfig;
+
+// Called for every event of a same-time batch, possibly concurrently.
+// iSlot (0 to MAX_BATCH_EVENTS-1) is the event's position in the batch
+// so the handler can leave its result where the callback will find it.
+// It must not call any sim function, and may run again for an event
+// whose batch a callback cut by scheduling at the current time.
+typedef void (*EventHandler)(Event event, int iSlot, void *pContext);
+
+// Called for every event, one at a time and in event order, after the
+// handler of its batch has finished.  It may schedule events and query,
+// but simStep and simRunUntil return SIM_ERR_BUSY.
+typedef void (*EventCallback)(Event event, int iSlot, void *pContext);
+
+/**********   prototypes ***********/
+Simulation simCreate(SimConfig *pConfig);
+void simDestroy(Simulation sim);
+int simSchedule(Simulation sim, Event event);
+int simScheduleVisit(Simulation sim, char szName[], int iArriveTime, int iDepartUnits);
+void simSetCallbacks(Simulation sim, EventHandler handler, EventCallback callback
+    , void *pContext);
+int simStep(Simulation sim, int iSteps);
+int simRunUntil(Simulation sim, int iTime);
+int simPeekNextTime(Simulation sim, int *piTime);
+int simGetClock(Simulation sim);
+int simGetOccupantCount(Simulation sim);
+int simGetOccupants(Simulation sim, char szNameM[][MAX_NAME_SIZE + 1], int iMaxNames);
+// simFindPerson reports when the person's current stay ends; with
+// overlapping visits that is the depart that ends the last of them.
+int simFindPerson(Simulation sim, char szName[], int *pbPresent, int *piDepartTime);
+
+// trace of a run: binary event log plus a sparse snapshot index
+int simEnableTrace(Simulation sim, FILE *pLogFile, FILE *pIndexFile, int iSnapshotEvents);
+int simQueryTrace(FILE *pLogFile, FILE *pIndexFile, int iTime
+    , char szNameM[][MAX_NAME_SIZE + 1], int iMaxNames, int *piPresentCnt);
+
+#endif
@@ -0,0 +1,51 @@
+#!/bin/sh
+# p3Check.sh - regression checks for program 3 and its simulation library
+#
+# Builds p3 and p3TraceCheck in a temporary directory, then
+#   1. runs p3 on p3Input.txt with the sequential, threaded, external-memory
+#      and traced configurations and compares each with p3Output.txt
+#   2. reads the trace written by the last run back with -r/-q
+#   3. runs p3TraceCheck, which compares simQueryTrace with simGetOccupants
+# Exits 0 if every check passes.  Run from any directory:
+#   sh p3Check.sh
+
+cd "$(dirname "$0")" || exit 1
+CC=${CC:-gcc}
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+$CC -pthread -o "$WORK/p3" cs2123p3.c cs2123p3sim.c || exit 1
+$CC -pthread -o "$WORK/p3TraceCheck" p3TraceCheck.c cs2123p3sim.c || exit 1
+
+for OPTS in "" "-t 4" "-m 4" "-m 4 -t 8 -w $WORK/trace"
+do
+    if "$WORK/p3" $OPTS < p3Input.txt | cmp -s - p3Output.txt
+    then
+        echo "ok      p3 $OPTS"
+    else
+        echo "FAILED  p3 $OPTS"
+        FAILED=1
+    fi
+done
+
+# who p3Output.txt shows present at a few times, sorted
+for QUERY in "0:Fred" "8:Daphne Fred Velma" "14:Shaggy" "22:Shaggy" "26:"
+do
+    TIME=${QUERY%%:*}
+    WANT=${QUERY#*:}
+    GOT=$("$WORK/p3" -r "$WORK/trace" -q "$TIME" \
+        | awk '$3 == "Present" {print $2}' | sort | tr '\n' ' ' | sed 's/ $//')
+    if [ "$GOT" = "$WANT" ]
+    then
+        echo "ok      p3 -r -q $TIME"
+    else
+        echo "FAILED  p3 -r -q $TIME: got '$GOT', expected '$WANT'"
+        FAILED=1
+    fi
+done
+
+"$WORK/p3TraceCheck" || FAILED=1
+
+[ $FAILED -eq 0 ] && echo "all checks passed"
+exit $FAILED
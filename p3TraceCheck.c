@@ -0,0 +1,205 @@
+/**********************************************************************
+Program p3TraceCheck.c
+Purpose:
+    Checks that a trace written by simEnableTrace answers simQueryTrace
+    with exactly the people simGetOccupants reported at that time during
+    the run.  Random visits are run one time unit at a time under each
+    backend, thread count and snapshot spacing; callbacks also schedule
+    visits at the current time so cut batches are traced too.
+Command Parameters:
+    p3TraceCheck
+Input:
+    N/A
+Results:
+    One line per configuration with its mismatch count.
+Returns:
+    0 if every query matched, 1 otherwise.
+Notes:
+    Build with the library, e.g.
+        gcc -pthread -o p3TraceCheck p3TraceCheck.c cs2123p3sim.c
+    p3Check.sh builds and runs it.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cs2123p3sim.h"
+
+#define CHECK_VISITS        4000   // visits scheduled before the run
+#define CHECK_PEOPLE        200    // distinct names used
+#define CHECK_END_TIME      1100   // last time queried, after every depart
+#define CHECK_MAX_NAMES     (CHECK_PEOPLE)
+
+typedef char NameArray[CHECK_MAX_NAMES][MAX_NAME_SIZE + 1];
+
+int checkTrace(SimConfig *pConfig, int iSnapshotEvents);
+void scheduleFromCallback(Event event, int iSlot, void *pContext);
+int compareNames(const void *pLeft, const void *pRight);
+
+// same-time visits added from callbacks so far, so each run is bounded
+static int iCallbackVisits;
+
+int main(void)
+{
+	int snapshotM[] = {1, 5, 64, 256, 1000000};
+	SimConfig configM[] =
+	{
+		{EQ_LINKED_LIST, 0, 0, 1, IDX_DEFAULT}
+		, {EQ_LINKED_LIST, 0, 0, 4, IDX_DEFAULT}
+		, {EQ_EXTERNAL, 4096, 0, 1, IDX_ON}
+		, {EQ_EXTERNAL, 4096, 0, 4, IDX_ON}
+	};
+	int iConfig;
+	int iSnapshot;
+	int iBad;
+	int iTotalBad = 0;
+	
+	for (iConfig = 0; iConfig < (int) (sizeof(configM) / sizeof(configM[0])); iConfig++)
+	{
+		for (iSnapshot = 0; iSnapshot < (int) (sizeof(snapshotM) / sizeof(snapshotM[0])); iSnapshot++)
+		{
+			iBad = checkTrace(&configM[iConfig], snapshotM[iSnapshot]);
+			printf("backend %d threads %d snapshot %-7d mismatches %d\n"
+				, configM[iConfig].iBackend, configM[iConfig].iThreadCnt
+				, snapshotM[iSnapshot], iBad);
+			iTotalBad += iBad;
+		}
+	}
+	return (iTotalBad == 0) ? 0 : 1;
+}
+/******************** checkTrace *****************************************
+int checkTrace(SimConfig *pConfig, int iSnapshotEvents)
+Purpose:
+    Runs one traced simulation and compares every time's trace query
+    with the occupants seen during the run.
+Parameters:
+    I  SimConfig *pConfig        simulation options
+    I  int iSnapshotEvents       passed to simEnableTrace
+
+Returns:
+    The number of times whose query did not match (a failure to create
+    the simulation or files counts as one).
+Notes:
+    The same seed is used for every configuration.  The occupants seen
+    at each time are kept in a temporary file until the trace is read.
+**************************************************************************/
+int checkTrace(SimConfig *pConfig, int iSnapshotEvents)
+{
+	static NameArray runNameM;
+	static NameArray traceNameM;
+	Simulation sim = simCreate(pConfig);
+	FILE *pLogFile = tmpfile();
+	FILE *pIndexFile = tmpfile();
+	FILE *pSeenFile = tmpfile();
+	char szName[MAX_NAME_SIZE + 1];
+	int iRunCnt;
+	int iTraceCnt;
+	int iTime;
+	int iBad = 0;
+	int i;
+	
+	if (sim == NULL || pLogFile == NULL || pIndexFile == NULL || pSeenFile == NULL
+		|| simEnableTrace(sim, pLogFile, pIndexFile, iSnapshotEvents) != SIM_OK)
+		iBad = 1;
+	
+	srand(2123);
+	iCallbackVisits = 0;
+	if (iBad == 0)
+	{
+		simSetCallbacks(sim, NULL, scheduleFromCallback, sim);
+		for (i = 0; i < CHECK_VISITS; i++)
+		{
+			sprintf(szName, "p%d", rand() % CHECK_PEOPLE);
+			simScheduleVisit(sim, szName, rand() % (CHECK_END_TIME - 100), rand() % 50);
+		}
+	
+		// run one time at a time and remember who was present
+		for (iTime = 0; iTime <= CHECK_END_TIME; iTime++)
+		{
+			if (simRunUntil(sim, iTime) < 0)
+				iBad++;
+			iRunCnt = simGetOccupants(sim, runNameM, CHECK_MAX_NAMES);
+			qsort(runNameM, iRunCnt, sizeof(runNameM[0]), compareNames);
+			fwrite(&iRunCnt, sizeof(iRunCnt), 1, pSeenFile);
+			fwrite(runNameM, sizeof(runNameM[0]), iRunCnt, pSeenFile);
+		}
+	
+		fflush(pLogFile);
+		fflush(pIndexFile);
+		rewind(pSeenFile);
+		for (iTime = 0; iTime <= CHECK_END_TIME; iTime++)
+		{
+			if (fread(&iRunCnt, sizeof(iRunCnt), 1, pSeenFile) != 1
+				|| (int) fread(runNameM, sizeof(runNameM[0]), iRunCnt, pSeenFile) != iRunCnt
+				|| simQueryTrace(pLogFile, pIndexFile, iTime, traceNameM
+					, CHECK_MAX_NAMES, &iTraceCnt) != SIM_OK
+				|| iTraceCnt != iRunCnt)
+			{
+				iBad++;
+				continue;
+			}
+			qsort(traceNameM, iTraceCnt, sizeof(traceNameM[0]), compareNames);
+			for (i = 0; i < iRunCnt; i++)
+			{
+				if (strcmp(runNameM[i], traceNameM[i]) != 0)
+				{
+					iBad++;
+					break;
+				}
+			}
+		}
+	}
+	
+	if (sim != NULL)
+		simDestroy(sim);
+	if (pLogFile != NULL)
+		fclose(pLogFile);
+	if (pIndexFile != NULL)
+		fclose(pIndexFile);
+	if (pSeenFile != NULL)
+		fclose(pSeenFile);
+	return iBad;
+}
+/******************** scheduleFromCallback *******************************
+void scheduleFromCallback(Event event, int iSlot, void *pContext)
+Purpose:
+    Callback that sometimes schedules another visit starting at the
+    current time.
+Parameters:
+    I  Event event               event just run
+    I  int iSlot                 its slot in the batch (unused)
+    I  void *pContext            the Simulation
+
+Returns:
+    N/A
+Notes:
+    Scheduling at the current time cuts the batch being committed.
+**************************************************************************/
+void scheduleFromCallback(Event event, int iSlot, void *pContext)
+{
+	Simulation sim = (Simulation) pContext;
+	char szName[MAX_NAME_SIZE + 1];
+	
+	if (event.iEventType != EVT_ARRIVE || iCallbackVisits >= CHECK_VISITS / 4
+		|| rand() % 8 != 0)
+		return;
+	iCallbackVisits++;
+	sprintf(szName, "p%d", rand() % CHECK_PEOPLE);
+	simScheduleVisit(sim, szName, event.iTime, rand() % 20);
+}
+/******************** compareNames ***************************************
+int compareNames(const void *pLeft, const void *pRight)
+Purpose:
+    qsort comparison for names.
+Parameters:
+    I  const void *pLeft         first name
+    I  const void *pRight        second name
+
+Returns:
+    <0, 0 or >0 as strcmp.
+Notes:
+    N/A
+**************************************************************************/
+int compareNames(const void *pLeft, const void *pRight)
+{
+	return strcmp((const char *) pLeft, (const char *) pRight);
+}